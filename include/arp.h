@@ -22,6 +22,20 @@ typedef struct arp_pkt {
 
 #pragma pack()
 
+typedef struct arp_pending { // 一个未解析地址的待发送包队列(FIFO)
+  buf_t bufs[ARP_PENDING_MAX]; // 环形队列，持有各包的引用
+  int head;                    // 队首下标
+  int cnt;                     // 队列中包的数量
+} arp_pending_t;
+
+typedef struct arp_stats { // 驻留队列的统计计数
+  size_t queued;           // 入队的包数
+  size_t flushed;          // 解析完成后发出的包数
+  size_t dropped;          // 因队列满、超出内存上限或超时而丢弃的包数
+} arp_stats_t;
+
+extern arp_stats_t arp_stats;
+
 void arp_init();
 void arp_print();
 void arp_in(buf_t *buf, uint8_t *src_mac);
@@ -5,19 +5,27 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+struct buf_slab;
+
 typedef struct buf //协议栈的通用数据包buffer,
                    //可以在头部装卸数据，以供协议头的添加和去除
 {
-  size_t len;                   // 包中有效数据大小
-  uint8_t *data;                // 包的数据起始地址
-  uint8_t payload[BUF_MAX_LEN]; // 最大负载数据量
+  size_t len;            // 包中有效数据大小
+  uint8_t *data;         // 包的数据起始地址
+  uint8_t *payload;      // 存储区起始地址，来自缓冲池中的slab
+  size_t cap;            // 存储区容量
+  struct buf_slab *slab; // 引用的slab，NULL表示尚未分配或借用外部存储区
 } buf_t;
 
 int buf_init(buf_t *buf, size_t len);
+void buf_wrap(buf_t *buf, uint8_t *data, size_t len);
+void buf_free(buf_t *buf);
 int buf_add_header(buf_t *buf, size_t len);
 int buf_remove_header(buf_t *buf, size_t len);
 int buf_add_padding(buf_t *buf, size_t len);
 int buf_remove_padding(buf_t *buf, size_t len);
 void buf_copy(void *pdst, const void *psrc, size_t len);
+void buf_ref(void *pdst, const void *psrc, size_t len);
+size_t buf_pool_avail();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,29 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// xn: 校验和均按内存中的字节序累加，部分和可以分段计算后再相加，
+// 但除最后一段外每段的长度都必须是偶数，否则后续字节的高低位会错开
+typedef uint32_t (*checksum_partial_t)(const void *data, size_t len,
+                                       uint32_t sum);
+typedef uint32_t (*checksum_copy_t)(void *dst, const void *src, size_t len,
+                                    uint32_t sum);
+
+typedef struct checksum_impl { // 校验和的一种实现，按CPU支持情况在运行时选择
+  const char *name;            // 实现名称，如scalar、sse2、avx2
+  checksum_partial_t partial;  // 累加部分和
+  checksum_copy_t copy;        // 拷贝数据的同时累加部分和
+} checksum_impl_t;
+
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum);
+uint32_t checksum_copy(void *dst, const void *src, size_t len, uint32_t sum);
+uint32_t checksum_pseudo(const uint8_t *src_ip, const uint8_t *dst_ip,
+                         uint8_t protocol, uint16_t len, uint32_t sum);
+uint16_t checksum_fold(uint32_t sum);
+uint16_t checksum16(uint16_t *data, size_t len);
+uint16_t checksum_update16(uint16_t check, uint16_t from, uint16_t to);
+uint16_t checksum_update32(uint16_t check, uint32_t from, uint32_t to);
+size_t checksum_impl_list(const checksum_impl_t **list);
+#endif
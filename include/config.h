@@ -25,13 +25,42 @@
 #endif
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
+#define NET_WAIT_MAX_MS 100 // net_wait单次阻塞的最长时间，应用借此定期检查自己的条件
+#define NET_BUSY_POLL_MIN_US 10  // 空闲后继续忙轮询的最短时间
+#define NET_BUSY_POLL_MAX_US 500 // 空闲后继续忙轮询的最长时间
+#define DRIVER_RX_BURST 32 // 每次轮询最多从网卡收取的帧数
+#define DRIVER_TX_BATCH 32 // 发送队列攒够这么多帧就立即批量发出
+#define DRIVER_TX_LATENCY_MS 0 // 帧在发送队列中最多等待的毫秒数，0为每轮都发出
+
+// 网卡驱动后端，编译时选择其一，由CMake的NET_DRIVER选项定义，默认为libpcap
+#if !defined(DRIVER_AF_PACKET) && !defined(DRIVER_TAP) &&                     \
+    !defined(DRIVER_LOOPBACK)
+#define DRIVER_PCAP
+#endif
+#define DRIVER_RING_BLOCK_SIZE (1 << 18) // AF_PACKET环形缓冲区的块大小
+#define DRIVER_RING_BLOCK_NR 16          // AF_PACKET接收环的块数
+#define DRIVER_RING_FRAME_SIZE 2048      // AF_PACKET环形缓冲区的帧槽大小
+#define DRIVER_TX_FRAME_NR 256           // AF_PACKET发送环的帧槽数
+#define DRIVER_TAP_NAME "tap0"           // TAP设备的默认名称
+#define DRIVER_TAP_FRAME_SIZE 2048       // TAP驱动接收缓冲区中每帧的大小
+#define DRIVER_LOOPBACK_RING_SIZE 1024 // 回环驱动每个方向的帧槽数，须为2的幂
+#define DRIVER_LOOPBACK_FRAME_SIZE 2048 // 回环驱动帧槽大小
+#define DRIVER_LOOPBACK_HOLD_MS 1 // 回环驱动模拟乱序时一个帧最多被扣留的毫秒数
+#define DRIVER_LOOPBACK_QUEUE_BYTES (128 * 1024) // 回环驱动模拟瓶颈的默认队列长度
 
 #define ARP_TIMEOUT_SEC (60 * 5) // arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
+#define ARP_PENDING_MAX 8 // 每个未解析地址最多驻留的待发送包数量
+#define ARP_PENDING_MAX_BYTES (64 * 1024) // 所有驻留待发送包的总字节数上限
 
 #define IP_DEFALUT_TTL 64 // IP默认TTL
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) // buf最大长度
+#define BUF_HEADROOM 128  // buf头部预留空间，用于逐层添加协议头
+#define BUF_SMALL_LEN 2048 // 小slab大小，可容纳一个MTU的帧及其头部预留
+#define BUF_SMALL_NUM 256  // 缓冲池中小slab的数量
+#define BUF_LARGE_NUM 8    // 缓冲池中大slab(BUF_MAX_LEN)的数量，为0则不启用
 
-#define MAP_MAX_LEN (16 * BUF_MAX_LEN) // map最大长度
+#define MAP_INIT_SIZE 16     // map初始分配的键值对数，装满后按倍数扩容
+#define MAP_MAX_SIZE 65536   // map默认的最大容量，map_init可单独指定
 #endif
\ No newline at end of file
@@ -8,6 +8,48 @@
 #endif
 int driver_open();
 int driver_recv(buf_t *buf);
+int driver_recv_burst(buf_t *bufs, int n);
 int driver_send(buf_t *buf);
+int driver_flush();
+int driver_tx_poll();
+int driver_fd();
+
+/**
+ * @brief 判断发送队列是否应当发出：攒够DRIVER_TX_BATCH个帧，
+ * 或最早的帧已等待DRIVER_TX_LATENCY_MS毫秒以上
+ *
+ * @param pending 队列中的帧数
+ * @param first_ms 最早的帧入队的时间
+ * @return int 应当发出为1
+ */
+static inline int driver_tx_due(int pending, uint64_t first_ms) {
+  return pending >= DRIVER_TX_BATCH ||
+         (pending && net_clock_ms() - first_ms >= DRIVER_TX_LATENCY_MS);
+}
 void driver_close();
+
+#ifdef DRIVER_LOOPBACK
+typedef struct driver_loopback_impair { // 回环驱动对发出的帧施加的损伤
+  double loss;       // 丢包率
+  double reorder;    // 乱序率，被选中的帧推迟到下一个帧之后送达
+  uint32_t delay_ms; // 单向时延
+  uint32_t rate_mbps;   // 瓶颈带宽，为0表示不限速
+  uint32_t queue_bytes; // 瓶颈前的队列长度，满则丢弃，为0取默认值
+} driver_loopback_impair_t;
+
+typedef struct driver_loopback_stats { // 回环驱动发送方向的统计计数
+  uint64_t sent;      // 送入环的帧数
+  uint64_t lost;      // 模拟丢包丢弃的帧数
+  uint64_t reordered; // 模拟乱序推迟的帧数
+  uint64_t overflow;  // 环已满而丢弃的帧数
+  uint64_t queue_drops;    // 瓶颈队列已满而丢弃的帧数
+  uint64_t queued;         // 经过瓶颈队列的帧数
+  uint64_t queue_delay_us; // 这些帧在瓶颈队列中等待的时间之和
+} driver_loopback_stats_t;
+
+extern driver_loopback_stats_t driver_loopback_stats;
+
+int driver_loopback_pair();
+void driver_loopback_side(int side, const driver_loopback_impair_t *impair);
+#endif
 #endif
\ No newline at end of file
@@ -2,32 +2,48 @@
 #define VECTOR_H
 
 #include "config.h"
+#include "timer.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
 typedef void (*map_constuctor_t)(void *dst, const void *src, size_t len);
+typedef void (*map_destructor_t)(void *value);
 typedef void (*map_entry_handler_t)(void *key, void *value, time_t *timestamp);
 
 // xn: NB，一个非常经典的C语言容器实现，值得学习
 // 大概结构： 三元组 <key, value, timestamp>
 // 可以是arp表、路由表、handler注册表
+// 键值对按插入位置紧凑存放在data中，另有开放寻址（线性探测）的哈希索引，
+// 索引槽中存放键值对的位置+1，0表示空槽。查找只需探测少数几个槽
+// 有超时时间的map为每个键值对挂一个时间轮定时器，到期即删除，不必等下次扫描
+// 三个数组都在堆上按capacity分配，装满时翻倍扩容并重建索引，直到max_size
+// 扩容时键值对的位置不变，但data会被realloc搬移，所以map_get返回的指针
+// 在之后的map_set（可能扩容）后失效，须重新map_get；map_delete不影响其他键值对
 typedef struct
     map //协议栈的通用泛型map，即键值对的容器，支持超时时间与非平凡值类型
 {
   size_t key_len;   //键的长度
   size_t value_len; //值的长度
   size_t size;      //当前大小
-  size_t max_size;  //最大容量
+  size_t max_size;  //最大容量，扩容不超过此值
+  size_t capacity;  //当前已分配的键值对数
   time_t timeout;   //超时时间，0为永不超时
   map_constuctor_t
       value_constuctor; //形如memcpy的值构造函数，用于拷贝非平凡数据结构到容器中，如buf_copy
-  uint8_t data[MAP_MAX_LEN]; //数据
-                             // xn: 此处data怎么不在init时动态分配呢
+  map_destructor_t
+      value_destructor; //值析构函数，值被覆盖、删除或过期复用时调用，如buf_free
+  size_t used;          //曾经使用过的键值对位置数
+  uint32_t free_pos;    //空闲键值对位置链表头，UINT32_MAX为空
+  size_t index_size;    //哈希索引的槽数
+  uint32_t *index;      //哈希索引，槽数为capacity的两倍
+  net_timer_t *timers;  //各键值对的超时定时器，无超时则为NULL
+  uint8_t *data;        //键值对数组
 } map_t;
 
 void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_len,
-              time_t timeout, map_constuctor_t value_constuctor);
+              time_t timeout, map_constuctor_t value_constuctor,
+              map_destructor_t value_destructor);
 size_t map_size(map_t *map);
 void *map_get(map_t *map, const void *key);
 int map_set(map_t *map, const void *key, const void *value);
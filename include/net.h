@@ -14,6 +14,8 @@ typedef enum net_protocol {
   NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
+#define NET_ETH_PROTOCOL_NUM 2 // 协议表支持的以太网类型数，见net_eth_index
+
 typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
 
 #define NET_MAC_LEN 6 // mac地址长度
@@ -21,10 +23,11 @@ typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
 
 extern uint8_t net_if_mac[NET_MAC_LEN];
 extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
+extern buf_t rxbuf[DRIVER_RX_BURST], txbuf; //单线程使用，接收按批进行
 
 int net_init();
-void net_poll();
+int net_poll();
+void net_wait();
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
 #endif
\ No newline at end of file
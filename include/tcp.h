@@ -2,9 +2,7 @@
 #define TCP_H
 
 #include "net.h"
-#include "queue.h"
-
-extern queue outstream;
+#include "timer.h"
 
 // TCPHeader
 // ~~~
@@ -42,31 +40,180 @@ typedef struct tcp_hdr {
   uint16_t uptr;       // urgent pointer
 } tcp_hdr_t;
 
-typedef struct tcp_peso_hdr {
-  uint8_t src_ip[4];    // 源IP地址
-  uint8_t dst_ip[4];    // 目的IP地址
-  uint8_t placeholder;  // 必须置0,用于填充对齐
-  uint8_t protocol;     // 协议号
-  uint16_t total_len16; // 整个数据包的长度
-} tcp_peso_hdr_t;
 #pragma pack()
 
 #define TCP_HEADER_LEN 20
-#define RETRANSMISSON_TIMEOUT 3 // 超时重传时间，设置为 3s
+#define TCP_RTO_INIT_MS 1000  // 还没有 RTT 测量值时的超时重传时间，RFC 6298
+#define TCP_RTO_MIN_MS 200    // 超时重传时间下限，与 Linux 相同，低于 RFC 的1秒
+#define TCP_RTO_MAX_MS 60000  // 超时重传时间上限，指数退避不会超过此值
+#define TCP_MAX_RETRIES 8     // 连续超时重传这么多次仍无进展则放弃连接
+#define TCP_TIME_WAIT_MS 2000 // TIME_WAIT 状态的停留时间，即 2MSL
+#define TCP_DUPACK_THRESH 3   // 收到这么多个重复确认就快速重传，RFC 5681
+#define TCP_RENEGE_WAIT_MS 10 // 确认停在 SACK 过的数据前时至少等这么久再重传
+#define TCP_CC_DEFAULT "reno" // 新连接默认的拥塞控制算法
+#define TCP_CC_PRIV_SIZE 32   // 拥塞控制算法私有状态的大小，单位为8字节
+#define TCP_PACING_QUANTUM_US 1000 // 限速发送时一次最多提前发出这么久的数据
+#define TCP_MSS_DEFAULT 536   // 未协商时的最大报文段长度
+// 本端接收的最大报文段长度，即以太网MTU减去ip和tcp首部
+#define TCP_MSS_LOCAL (ETHERNET_MAX_TRANSPORT_UNIT - 20 - TCP_HEADER_LEN)
+#define TCP_RCV_BUF_SIZE (256 * 1024) // 每个连接的接收缓冲区大小，决定接收窗口
+#define TCP_SND_BUF_SIZE (256 * 1024) // 每个连接的发送缓冲区上限
+// 每个连接的乱序队列最多占用的 slab 数，乱序队列中每段数据占一个 slab
+#define TCP_OOO_MAX_SLABS (BUF_SMALL_NUM / 2)
+// 乱序队列不使缓冲池中空闲的小 slab 少于此数，留给收到的帧，包括补空缺的重传
+#define TCP_OOO_POOL_RESERVE (BUF_SMALL_NUM / 4)
+#define TCP_WSCALE_MAX 14             // RFC 7323 规定的窗口扩大因子上限
 #define FLAG_ACK (0x10)         /* 0b0001'0000 */
+#define FLAG_RST (0x04)         /* 0b0000'0100 */
 #define FLAG_SYN (0x02)         /* 0b0000'0010 */
 #define FLAG_FIN (0x01)         /* 0b0000'0001 */
 
+#define TCP_SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define TCP_SEQ_GT(a, b) ((int32_t)((a) - (b)) > 0)
+#define TCP_SEQ_GEQ(a, b) ((int32_t)((a) - (b)) >= 0)
+
 typedef void (*tcp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip,
                               uint16_t src_port);
 
+typedef enum tcp_state { // RFC 793 连接状态，LISTEN 由端口表表示
+  TCP_SYN_SENT,
+  TCP_SYN_RCVD,
+  TCP_ESTABLISHED,
+  TCP_FIN_WAIT_1,
+  TCP_FIN_WAIT_2,
+  TCP_CLOSE_WAIT,
+  TCP_CLOSING,
+  TCP_LAST_ACK,
+  TCP_TIME_WAIT,
+} tcp_state_t;
+
+#pragma pack(1)
+typedef struct tcp_key { // 连接表的键，即连接的四元组
+  uint8_t local_ip[NET_IP_LEN];
+  uint16_t local_port;
+  uint8_t remote_ip[NET_IP_LEN];
+  uint16_t remote_port;
+} tcp_key_t;
+#pragma pack()
+
+typedef enum tcp_ca_state { // 丢包恢复的阶段，名称同 Linux
+  TCP_CA_OPEN,               // 没有丢包
+  TCP_CA_RECOVERY,           // 快速恢复，RFC 6582 NewReno
+  TCP_CA_LOSS,               // 超时后的恢复
+} tcp_ca_state_t;
+
+typedef struct tcp_stats { // 所有连接的重传计数
+  uint64_t fast_retransmits;    // 重复确认触发的快速重传次数
+  uint64_t partial_retransmits; // 快速恢复中由部分确认触发的重传次数
+  uint64_t timeout_retransmits; // 超时次数
+  uint64_t loss_retransmits;    // 超时后由确认逐个触发的重传次数
+  uint64_t sack_retransmits;    // 按 SACK 记分板重传空缺的次数
+  uint64_t ooo_drops; // 超出 slab 份额或缓冲池余量不足而丢弃的乱序数据段数
+} tcp_stats_t;
+
+extern tcp_stats_t tcp_stats;
+
+typedef struct tcp_seg { // 重传队列中的一个报文段，数据仍在发送缓冲区中
+  uint32_t seq;           // 起始序号
+  uint32_t len;           // 占用的序号数，包括 SYN 和 FIN
+  uint8_t flags;          // 标志位
+  uint8_t rexmit;         // 是否重传过，重传过的不用于测量 RTT（Karn 算法）
+  uint8_t sacked;         // 对方已通过 SACK 告知收到
+  uint8_t counted;        // 已计入 delivered，SACK 标记清除后也不再计入
+  uint64_t sent_us;       // 最近一次发送的时间
+  uint64_t delivered;     // 发送时连接已交付的字节数，用于测量交付速率
+  uint64_t delivered_us;  // 发送时最近一次交付的时间
+  uint64_t first_sent_us; // 发送时最近一次被确认的报文段的发送时间
+} tcp_seg_t;
+
+typedef struct tcp_ooo { // 乱序队列中的一段数据，各段互不重叠
+  uint32_t seq;           // 起始序号
+  int fin;                // 数据之后紧跟着 FIN
+  buf_t buf;              // 引用缓冲池中的 slab，不拷贝数据
+} tcp_ooo_t;
+
+struct tcp_cc_ops;
+
+typedef struct tcp_tcb { // 传输控制块，每个连接一个，地址在连接存续期间不变
+  tcp_key_t key;
+  tcp_state_t state;
+  tcp_handler_t handler; // 收到数据时的回调函数
+  /* 发送方向，变量名同 RFC 793 */
+  uint32_t iss;       // 初始发送序号
+  uint32_t snd_una;   // 最早的未确认序号
+  uint32_t snd_nxt;   // 下一个要发送的序号
+  uint32_t snd_wnd;   // 对方通告的窗口
+  uint32_t snd_wl1;   // 上次更新窗口的报文段序号
+  uint32_t snd_wl2;   // 上次更新窗口的报文段确认号
+  uint16_t snd_mss;   // 发送报文段的最大长度
+  uint8_t snd_wscale; // 对方通告窗口的扩大因子，未协商为0
+  int fin_queued;     // 应用已关闭连接，发完缓冲区中的数据后发送 FIN
+  /* 发送缓冲区，存放已交给协议栈但尚未被确认的数据 */
+  uint8_t *snd_buf;
+  uint32_t snd_cap; // 已分配的大小
+  uint32_t snd_off; // 有效数据在缓冲区中的起始位置
+  uint32_t snd_len; // 有效数据的长度
+  uint32_t buf_seq; // 有效数据第一个字节的序号
+  /* 接收方向 */
+  uint32_t irs;       // 初始接收序号
+  uint32_t rcv_nxt;   // 期望收到的下一个序号
+  uint32_t rcv_adv;   // 已通告的窗口右沿，之后通告的窗口不会使其左移
+  uint8_t rcv_wscale; // 本端通告窗口的扩大因子，未协商为0
+  int wscale_ok;      // 对方的 SYN 带有窗口扩大选项
+  int sack_ok;        // 对方的 SYN 带有允许 SACK 选项
+  int ack_now;        // 需要立即发送确认
+  int delivering;     // 正在把收到的数据交给应用，应用发送的数据等交付完再发
+  /* 时间戳选项，变量名同 RFC 7323 */
+  int ts_ok;              // 双方的 SYN 都带有时间戳选项
+  uint32_t ts_offset;     // 本端时间戳相对毫秒时钟的偏移，各连接不同
+  uint32_t ts_recent;     // 要回显给对方的时间戳，即 TS.Recent
+  uint32_t last_ack_sent; // 最近发出的确认号，即 Last.ACK.sent
+  /* 乱序队列，按序号排列的数组，空缺补上后依次交给应用 */
+  tcp_ooo_t *ooo;
+  uint32_t ooo_cap; // 已分配的项数
+  uint32_t ooo_cnt; // 数据段数
+  uint32_t sack_last; // 最近收到的乱序数据的序号，第一个 SACK 块须包含它
+  /* 重传队列，按序号排列的环形数组，覆盖所有已发送未确认的报文段 */
+  tcp_seg_t *rtx;
+  uint32_t rtx_cap;  // 已分配的项数，为2的幂
+  uint32_t rtx_head; // 最早的报文段所在的位置
+  uint32_t rtx_cnt;  // 报文段数
+  /* 超时重传，变量名同 RFC 6298 */
+  uint32_t srtt_us;   // 平滑的往返时间，为0表示还没有测量值
+  uint32_t rttvar_us; // 往返时间的平均偏差
+  uint32_t rto_ms;    // 超时重传时间，超时后加倍直到得到新的测量值
+  net_timer_t timer;  // 超时重传定时器，也用作坚持定时器和 2MSL 定时器
+  int retries;        // 连续超时重传的次数
+  /* 坚持定时器，对方窗口为零且没有数据在途时由 timer 兼任 */
+  uint32_t persist_ms; // 零窗口探测的间隔，每次探测后加倍
+  int probes;          // 连续没有得到回应的零窗口探测数，收到确认即清零
+  /* 丢包恢复 */
+  tcp_ca_state_t ca_state; // 所处的阶段
+  uint32_t recover;        // 进入恢复时的 snd_nxt，确认越过它才算恢复完成
+  uint32_t dupacks;        // 连续收到的重复确认数
+  uint32_t high_rxt;       // 本次恢复中已重传到的位置，RFC 6675 的 HighRxt
+  /* 拥塞控制 */
+  const struct tcp_cc_ops *cc;        // 所用的算法
+  uint32_t cwnd;                      // 拥塞窗口，字节
+  uint32_t ssthresh;                  // 慢启动阈值，字节
+  uint64_t delivered;                 // 已被确认的字节数
+  uint64_t delivered_us;              // 最近一次有数据被确认的时间
+  uint64_t first_sent_us;             // 最近一次被确认的报文段的发送时间
+  uint64_t pace_next_us;              // 限速发送时下一个报文段的发送时间
+  net_timer_t pace_timer;             // 限速发送的定时器
+  uint64_t cc_priv[TCP_CC_PRIV_SIZE]; // 算法私有的状态
+} tcp_tcb_t;
+
 void tcp_init();
 void tcp_in(buf_t *buf, uint8_t *src_ip);
-void tcp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip,
-              uint16_t dst_port);
-void tcp_connect(uint16_t port, uint8_t *dst_ip);
-void tcp_tick(); // 由 net class 周期性调用
+int tcp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip,
+             uint16_t dst_port);
+int tcp_connect(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 int tcp_open(uint16_t port, tcp_handler_t handler, int server);
-int tcp_is_closed();
-void tcp_close(uint16_t port, uint8_t *dst_ip);
+int tcp_is_closed(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void tcp_close(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+size_t tcp_count();
+int tcp_set_cc(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port,
+               const char *name);
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef TCP_CC_H
+#define TCP_CC_H
+
+#include "tcp.h"
+
+// xn: 拥塞控制模块只通过下面的回调与 tcp 交互，算法私有的状态放在
+// tcb->cc_priv 中。tcp 负责重传、丢包检测和 RTT 测量，模块只决定 cwnd、
+// ssthresh 和发送速率；pacing_rate 返回0表示不限速，只受 cwnd 约束
+
+typedef struct tcp_rate_sample { // 一个推进 snd_una 的确认带来的测量值
+  uint32_t acked;                // 新确认的字节数
+  uint32_t prior_inflight;       // 收到确认之前在途的字节数
+  uint64_t prior_delivered;      // 被确认的最后一个报文段发送时的 delivered
+  uint64_t delivery_rate;        // 交付速率，字节/秒，为0表示没有测量值
+} tcp_rate_sample_t;
+
+typedef struct tcp_cc_ops {
+  const char *name;
+  void (*init)(tcp_tcb_t *tcb); // 连接建立或切换算法时调用
+  void (*on_ack)(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs);
+  void (*on_rtt)(tcp_tcb_t *tcb, uint32_t rtt_us); // 得到 RTT 测量值时调用
+  void (*on_loss)(tcp_tcb_t *tcb, int timeout); // 进入快速恢复或超时时调用
+  uint64_t (*pacing_rate)(tcp_tcb_t *tcb);      // 字节/秒，为0表示不限速
+} tcp_cc_ops_t;
+
+extern const tcp_cc_ops_t tcp_cc_reno;
+extern const tcp_cc_ops_t tcp_cc_cubic;
+extern const tcp_cc_ops_t tcp_cc_bbr;
+
+const tcp_cc_ops_t *tcp_cc_find(const char *name);
+uint32_t tcp_cc_initial_cwnd(tcp_tcb_t *tcb);
+uint32_t tcp_cc_inflight(tcp_tcb_t *tcb);
+int tcp_cc_cwnd_limited(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs);
+void tcp_cc_slow_start(tcp_tcb_t *tcb, uint32_t acked);
+#endif
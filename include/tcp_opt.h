@@ -0,0 +1,43 @@
+#ifndef TCP_OPT_H
+#define TCP_OPT_H
+
+#include "tcp.h"
+
+// xn: tcp 选项的解析、填写和协商都在这里。收到的报文先解析成 tcp_opts_t，
+// SYN 中的选项决定连接使用哪些扩展，之后发出的每个报文段按协商结果填写选项。
+// 填写的选项都按4字节对齐，与 Linux 一样用 NOP 补齐
+
+#define TCP_OPT_EOL 0       // 选项表结束
+#define TCP_OPT_NOP 1       // 填充
+#define TCP_OPT_MSS 2       // 最大报文段长度，只出现在 SYN 中
+#define TCP_OPT_WSCALE 3    // 窗口扩大因子，只出现在 SYN 中
+#define TCP_OPT_SACK_PERM 4 // 允许 SACK，只出现在 SYN 中
+#define TCP_OPT_SACK 5      // SACK 块，RFC 2018
+#define TCP_OPT_TS 8        // 时间戳，RFC 7323
+#define TCP_OPT_MAX_LEN 40  // 首部长度字段允许的选项最大长度
+#define TCP_OPT_TS_LEN 12   // 对齐后的时间戳选项长度，协商后每个报文段都带
+#define TCP_SACK_MAX_BLOCKS 4 // 一个报文最多携带的 SACK 块数，受选项长度限制
+
+extern int tcp_sack;
+extern int tcp_timestamps;
+
+typedef struct tcp_opts { // 从收到的报文中解析出的选项
+  uint16_t mss;           // 为0表示没有该选项
+  uint8_t wscale;
+  int has_wscale;
+  int sack_ok;                           // 允许 SACK
+  int sack_cnt;                          // SACK 块数
+  uint32_t sack[TCP_SACK_MAX_BLOCKS][2]; // SACK 块的左右边界
+  int has_ts;                            // 带有时间戳选项
+  uint32_t tsval;                        // 对方发送时的时间戳
+  uint32_t tsecr;                        // 对方回显的本端时间戳
+} tcp_opts_t;
+
+void tcp_opt_parse(tcp_hdr_t *hdr, int head_len, tcp_opts_t *opts);
+void tcp_opt_syn_in(tcp_tcb_t *tcb, tcp_opts_t *opts);
+uint8_t tcp_opt_build(tcp_tcb_t *tcb, uint8_t flags, uint32_t len,
+                      uint8_t *opt);
+int tcp_opt_paws_ok(tcp_tcb_t *tcb, tcp_opts_t *opts);
+void tcp_opt_ts_update(tcp_tcb_t *tcb, tcp_opts_t *opts, uint32_t seq);
+uint32_t tcp_opt_ts_rtt_us(tcp_tcb_t *tcb, tcp_opts_t *opts);
+#endif
@@ -0,0 +1,29 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define TIMER_ROOT_BITS 8  // 第0层时间轮槽数的位数，每槽1毫秒
+#define TIMER_LEVEL_BITS 6 // 其余各层时间轮槽数的位数
+#define TIMER_LEVELS 4     // 除第0层外的层数，共覆盖 2^32 毫秒
+
+struct net_timer;
+typedef void (*timer_handler_t)(struct net_timer *timer);
+
+typedef struct net_timer { // 协议栈定时器，嵌入到需要超时处理的结构中
+  struct net_timer *next;  // 所在时间轮槽的双向链表
+  struct net_timer *prev;  // 为NULL表示定时器未启动
+  uint64_t expire;         // 到期时间，单调毫秒时钟
+  timer_handler_t handler; // 到期时的回调函数
+  void *arg;               // 回调函数使用的参数
+} net_timer_t;
+
+void timer_add(net_timer_t *timer, uint64_t timeout_ms,
+               timer_handler_t handler, void *arg);
+void timer_del(net_timer_t *timer);
+void timer_move(net_timer_t *dst, net_timer_t *src);
+int timer_pending(net_timer_t *timer);
+int timer_run(uint64_t now_ms);
+int64_t timer_next(uint64_t now_ms);
+#endif
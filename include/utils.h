@@ -1,10 +1,10 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "checksum.h"
 #include <stdint.h>
 #include <time.h>
 
-uint16_t checksum16(uint16_t *data, size_t len);
 #define swap16(x)                                                              \
   ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
 
@@ -15,5 +15,9 @@ uint16_t checksum16(uint16_t *data, size_t len);
 char *iptos(uint8_t *ip);
 char *mactos(uint8_t *mac);
 char *timetos(time_t timestamp);
+void net_clock_update();
+time_t net_clock();
+uint64_t net_clock_ms();
+uint64_t net_clock_us();
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb);
 #endif
\ No newline at end of file
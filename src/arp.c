@@ -12,8 +12,6 @@ static const arp_pkt_t arp_init_pkt = {.hw_type16 = swap16(ARP_HW_ETHER),
                                        .pro_type16 = swap16(NET_PROTOCOL_IP),
                                        .hw_len = NET_MAC_LEN,
                                        .pro_len = NET_IP_LEN,
-                                       .sender_ip = NET_IF_IP,
-                                       .sender_mac = NET_IF_MAC,
                                        .target_mac = {0}};
 
 /**
@@ -23,11 +21,60 @@ static const arp_pkt_t arp_init_pkt = {.hw_type16 = swap16(ARP_HW_ETHER),
 map_t arp_table;
 
 /**
- * @brief arp buffer，<ip, buf_t>的容器
+ * @brief arp buffer，<ip, arp_pending_t>的容器，只持有待发送包的引用而不拷贝
  *
  */
 map_t arp_buf;
 
+/**
+ * @brief 驻留队列的统计计数
+ *
+ */
+arp_stats_t arp_stats;
+
+/**
+ * @brief 当前所有驻留包的总字节数
+ *
+ */
+static size_t arp_pending_bytes = 0;
+
+/**
+ * @brief 驻留队列析构函数，队列被删除或过期复用时释放其中的包
+ *
+ * @param value 要释放的驻留队列
+ */
+static void arp_pending_free(void *value) {
+  arp_pending_t *q = value;
+  while (q->cnt > 0) {
+    buf_t *buf = &q->bufs[q->head];
+    arp_pending_bytes -= buf->len;
+    arp_stats.dropped++;
+    buf_free(buf);
+    q->head = (q->head + 1) % ARP_PENDING_MAX;
+    q->cnt--;
+  }
+}
+
+/**
+ * @brief 把一个包加入驻留队列末尾
+ *
+ * @param q 驻留队列
+ * @param buf 要加入的包
+ * @return int 成功为0，队列满或超出内存上限为-1
+ */
+static int arp_pending_push(arp_pending_t *q, buf_t *buf) {
+  if (q->cnt == ARP_PENDING_MAX ||
+      arp_pending_bytes + buf->len > ARP_PENDING_MAX_BYTES) {
+    arp_stats.dropped++;
+    return -1;
+  }
+  buf_ref(&q->bufs[(q->head + q->cnt) % ARP_PENDING_MAX], buf, 0);
+  q->cnt++;
+  arp_pending_bytes += buf->len;
+  arp_stats.queued++;
+  return 0;
+}
+
 /**
  * @brief 打印一条arp表项
  *
@@ -47,6 +94,8 @@ void arp_print() {
   printf("===ARP TABLE BEGIN===\n");
   map_foreach(&arp_table, arp_entry_print);
   printf("===ARP TABLE  END ===\n");
+  printf("pending: queued %zu, flushed %zu, dropped %zu\n", arp_stats.queued,
+         arp_stats.flushed, arp_stats.dropped);
 }
 
 /**
@@ -55,10 +104,13 @@ void arp_print() {
  * @param target_ip 想要知道的目标的ip地址
  */
 void arp_req(uint8_t *target_ip) {
-  buf_init(&txbuf, sizeof(arp_pkt_t));
+  if (buf_init(&txbuf, sizeof(arp_pkt_t)) < 0)
+    return;
 
   arp_pkt_t *arp = (arp_pkt_t *)txbuf.data;
   memcpy(arp, &arp_init_pkt, sizeof(arp_pkt_t));
+  memcpy(arp->sender_ip, net_if_ip, NET_IP_LEN * sizeof(uint8_t));
+  memcpy(arp->sender_mac, net_if_mac, NET_MAC_LEN * sizeof(uint8_t));
   uint16_t opcode = ARP_REQUEST;
   opcode = swap16(opcode);
   memcpy(&(arp->opcode16), &opcode, sizeof(uint16_t));
@@ -75,10 +127,13 @@ void arp_req(uint8_t *target_ip) {
  * @param target_mac 目标mac地址
  */
 void arp_resp(uint8_t *target_ip, uint8_t *target_mac) {
-  buf_init(&txbuf, sizeof(arp_pkt_t));
+  if (buf_init(&txbuf, sizeof(arp_pkt_t)) < 0)
+    return;
 
   arp_pkt_t *arp = (arp_pkt_t *)txbuf.data;
   memcpy(arp, &arp_init_pkt, sizeof(arp_pkt_t));
+  memcpy(arp->sender_ip, net_if_ip, NET_IP_LEN * sizeof(uint8_t));
+  memcpy(arp->sender_mac, net_if_mac, NET_MAC_LEN * sizeof(uint8_t));
   uint16_t opcode = ARP_REPLY;
   opcode = swap16(opcode);
   memcpy(&(arp->opcode16), &opcode, sizeof(uint16_t));
@@ -124,16 +179,24 @@ void arp_in(buf_t *buf, uint8_t *src_mac) {
     故而有驻留数据的情况和需要response的情况不可能同时发生。
   */
   if (p.opcode16 == swap16(ARP_REQUEST)) { // 如果是 ARP Request
-    if (0 == memcmp(p.target_ip, arp_init_pkt.sender_ip,
+    if (0 == memcmp(p.target_ip, net_if_ip,
                     NET_IP_LEN * sizeof(uint8_t))) {
       arp_resp(p.sender_ip, p.sender_mac);
     }
   }
 
   // 查询该新 ip 地址是否有驻留缓存
-  buf_t *sendBuf = map_get(&arp_buf, p.sender_ip);
-  if (sendBuf) { // 发送驻留帧
-    ethernet_out(sendBuf, p.sender_mac, NET_PROTOCOL_IP);
+  arp_pending_t *q = map_get(&arp_buf, p.sender_ip);
+  if (q) { // 按入队顺序发送驻留帧
+    while (q->cnt > 0) {
+      buf_t *buf = &q->bufs[q->head];
+      arp_pending_bytes -= buf->len;
+      ethernet_out(buf, p.sender_mac, NET_PROTOCOL_IP);
+      arp_stats.flushed++;
+      buf_free(buf);
+      q->head = (q->head + 1) % ARP_PENDING_MAX;
+      q->cnt--;
+    }
     map_delete(&arp_buf, p.sender_ip);
   }
 }
@@ -152,11 +215,18 @@ void arp_out(buf_t *buf, uint8_t *ip) {
     return;
   }
 
-  buf_t *p = map_get(&arp_buf, ip);
-  if (p)
-    return; // 直接丢弃
+  arp_pending_t *q = map_get(&arp_buf, ip);
+  if (q) { // 已发过请求，排队等待响应
+    arp_pending_push(q, buf);
+    return;
+  }
 
-  map_set(&arp_buf, ip, buf);
+  arp_pending_t empty = {0};
+  if (map_set(&arp_buf, ip, &empty) < 0) {
+    arp_stats.dropped++;
+    return;
+  }
+  arp_pending_push(map_get(&arp_buf, ip), buf);
   arp_req(ip);
 }
 
@@ -165,8 +235,10 @@ void arp_out(buf_t *buf, uint8_t *ip) {
  *
  */
 void arp_init() {
-  map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-  map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
+  map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL,
+           NULL);
+  map_init(&arp_buf, NET_IP_LEN, sizeof(arp_pending_t), 0, ARP_MIN_INTERVAL,
+           NULL, arp_pending_free);
   net_add_protocol(NET_PROTOCOL_ARP, arp_in);
   arp_req(net_if_ip);
 }
\ No newline at end of file
@@ -1,26 +1,171 @@
 #include "buf.h"
 #include <stdio.h>
 #include <string.h>
+
+/**
+ * @brief 缓冲池中的slab，即buf真正的存储区，多个buf可以引用同一个slab
+ *
+ */
+typedef struct buf_slab {
+  struct buf_slab *next; // 空闲链表中的下一个slab
+  int ref;               // 引用计数，为0时归还缓冲池
+  size_t cap;            // 存储区容量
+  uint8_t *mem;          // 存储区
+} buf_slab_t;
+
+/**
+ * @brief 缓冲池，分为MTU大小的小slab与BUF_MAX_LEN大小的大slab两类
+ *
+ */
+static uint8_t buf_small_mem[BUF_SMALL_NUM][BUF_SMALL_LEN];
+static buf_slab_t buf_small_slab[BUF_SMALL_NUM];
+static buf_slab_t *buf_small_free;
+#if BUF_LARGE_NUM > 0
+static uint8_t buf_large_mem[BUF_LARGE_NUM][BUF_MAX_LEN];
+static buf_slab_t buf_large_slab[BUF_LARGE_NUM];
+#endif
+static buf_slab_t *buf_large_free;
+static size_t buf_small_avail; // 空闲的小slab数
+static int buf_pool_ready = 0;
+
+/**
+ * @brief 内部函数，首次使用时把所有slab串入空闲链表
+ *
+ */
+static void buf_pool_init() {
+  for (int i = BUF_SMALL_NUM - 1; i >= 0; i--) {
+    buf_small_slab[i].cap = BUF_SMALL_LEN;
+    buf_small_slab[i].mem = buf_small_mem[i];
+    buf_small_slab[i].next = buf_small_free;
+    buf_small_free = &buf_small_slab[i];
+  }
+  buf_small_avail = BUF_SMALL_NUM;
+#if BUF_LARGE_NUM > 0
+  for (int i = BUF_LARGE_NUM - 1; i >= 0; i--) {
+    buf_large_slab[i].cap = BUF_MAX_LEN;
+    buf_large_slab[i].mem = buf_large_mem[i];
+    buf_large_slab[i].next = buf_large_free;
+    buf_large_free = &buf_large_slab[i];
+  }
+#endif
+  buf_pool_ready = 1;
+}
+
+/**
+ * @brief 内部函数，从缓冲池中取出一个能容纳size字节的slab
+ *
+ * @param size 需要的容量
+ * @return buf_slab_t* 取出的slab，缓冲池耗尽为NULL
+ */
+static buf_slab_t *buf_slab_alloc(size_t size) {
+  if (!buf_pool_ready)
+    buf_pool_init();
+  buf_slab_t **list = NULL;
+  if (size <= BUF_SMALL_LEN && buf_small_free)
+    list = &buf_small_free;
+  else if (size <= BUF_MAX_LEN && buf_large_free)
+    list = &buf_large_free;
+  if (list == NULL)
+    return NULL;
+
+  buf_slab_t *slab = *list;
+  *list = slab->next;
+  if (list == &buf_small_free)
+    buf_small_avail--;
+  slab->next = NULL;
+  slab->ref = 1;
+  return slab;
+}
+
+/**
+ * @brief 内部函数，释放slab的一个引用，引用计数归零时归还缓冲池
+ *
+ * @param slab 要释放的slab
+ */
+static void buf_slab_put(buf_slab_t *slab) {
+  if (--slab->ref > 0)
+    return;
+  buf_slab_t **list =
+      slab->cap == BUF_SMALL_LEN ? &buf_small_free : &buf_large_free;
+  if (list == &buf_small_free)
+    buf_small_avail++;
+  slab->next = *list;
+  *list = slab;
+}
+
+/**
+ * @brief 缓冲池中空闲的小slab数。收到的帧都放在小slab中，
+ * 长期持有slab的模块据此给收包留出余量
+ *
+ * @return size_t 空闲的小slab数
+ */
+size_t buf_pool_avail() {
+  if (!buf_pool_ready)
+    buf_pool_init();
+  return buf_small_avail;
+}
+
 /**
  * @brief 初始化buffer为给定的长度，用于装载数据包
+ * 若buffer已独占一个足够大的slab则直接复用，否则从缓冲池中重新取一个。
+ * buffer在第一次初始化前必须清零
  *
  * @param buf 要初始化的buffer
  * @param len 数据初始长度
  * @return int 成功为0，失败为-1
  */
 int buf_init(buf_t *buf, size_t len) {
-  if (len >= BUF_MAX_LEN / 2) {
+  size_t size = BUF_HEADROOM + len;
+  if (size > BUF_MAX_LEN) {
     fprintf(stderr, "Error in buf_init:%zu\n", len);
     return -1;
   }
 
-  buf->len = len;
-  // xn: [0, BUFMAXLEN/2] 为 data 区（自右向左增长）， [BUFMAXLEN/2, end] 为
+  if (buf->slab && (buf->slab->ref > 1 || buf->slab->cap < size))
+    buf_free(buf);
+  if (buf->slab == NULL) {
+    buf->slab = buf_slab_alloc(size);
+    if (buf->slab == NULL) {
+      fprintf(stderr, "Error in buf_init: buffer pool exhausted\n");
+      return -1;
+    }
+  }
+
+  // xn: [0, BUF_HEADROOM) 为头部预留区（协议头自右向左增长），其后为数据区与
   // padding 区
-  buf->data = buf->payload + BUF_MAX_LEN / 2 - len;
+  buf->payload = buf->slab->mem;
+  buf->cap = buf->slab->cap;
+  buf->len = len;
+  buf->data = buf->payload + BUF_HEADROOM;
   return 0;
 }
 
+/**
+ * @brief 释放buffer对slab的引用，之后buffer可以重新初始化
+ *
+ * @param buf 要释放的buffer
+ */
+void buf_free(buf_t *buf) {
+  if (buf->slab)
+    buf_slab_put(buf->slab);
+  memset(buf, 0, sizeof(buf_t));
+}
+
+/**
+ * @brief 让buffer借用一段外部存储区（如驱动的接收环形缓冲区），不拷贝数据。
+ * 借用的buffer不持有引用，存储区归还前必须处理完毕；
+ * 之后再buf_init会从缓冲池取新的slab，不会改写外部存储区
+ *
+ * @param buf 要设置的buffer
+ * @param data 外部存储区
+ * @param len 数据长度
+ */
+void buf_wrap(buf_t *buf, uint8_t *data, size_t len) {
+  buf_free(buf);
+  buf->payload = buf->data = data;
+  buf->len = buf->cap = len;
+}
+
 /**
  * @brief 为buffer在头部增加一段长度，用于添加协议头
  *
@@ -63,7 +208,7 @@ int buf_remove_header(buf_t *buf, size_t len) {
  * @return int 成功为0，失败为-1
  */
 int buf_add_padding(buf_t *buf, size_t len) {
-  if (buf->data + buf->len + len >= buf->payload + BUF_MAX_LEN) {
+  if (buf->data + buf->len + len > buf->payload + buf->cap) {
     fprintf(stderr, "Error in buf_add_padding:%zu+%zu\n", buf->len, len);
     return -1;
   }
@@ -89,7 +234,8 @@ int buf_remove_padding(buf_t *buf, size_t len) {
 }
 
 /**
- * @brief buf拷贝构造函数
+ * @brief buf拷贝构造函数，目的buffer视为未初始化，会从缓冲池取新的slab。
+ * 只拷贝有效数据[data, data+len)，头部预留区保持原有大小但不拷贝内容
  *
  * @param pdst 目的buffer
  * @param psrc 源buffer
@@ -98,7 +244,36 @@ int buf_remove_padding(buf_t *buf, size_t len) {
 void buf_copy(void *pdst, const void *psrc, size_t len) {
   buf_t *dst = pdst;
   const buf_t *src = psrc;
+  size_t headroom = src->data - src->payload;
+  memset(dst, 0, sizeof(buf_t));
+  dst->slab = buf_slab_alloc(headroom + src->len);
+  if (dst->slab == NULL) {
+    fprintf(stderr, "Error in buf_copy: buffer pool exhausted\n");
+    return;
+  }
+  dst->payload = dst->slab->mem;
+  dst->cap = dst->slab->cap;
   dst->len = src->len;
-  dst->data = dst->payload + (src->data - src->payload);
-  memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+  dst->data = dst->payload + headroom;
+  memcpy(dst->data, src->data, src->len);
+}
+
+/**
+ * @brief buf引用构造函数，目的buffer与源buffer共享同一个slab，不拷贝数据。
+ * 之后任一方再次buf_init时会换用新的slab，不会改写对方的数据
+ *
+ * @param pdst 目的buffer
+ * @param psrc 源buffer
+ * @param len 占位用，与memcpy保持形式一致，无意义
+ */
+void buf_ref(void *pdst, const void *psrc, size_t len) {
+  buf_t *dst = pdst;
+  const buf_t *src = psrc;
+  if (src->slab == NULL && src->payload) { // 借用的外部存储区可能被归还，需拷贝
+    buf_copy(dst, src, len);
+    return;
+  }
+  memcpy(dst, src, sizeof(buf_t));
+  if (dst->slab)
+    dst->slab->ref++;
 }
@@ -0,0 +1,354 @@
+#include "checksum.h"
+#include "utils.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief 内部函数，把64位累加和折叠为32位，进位加回低位
+ *
+ * @param sum 64位累加和
+ * @return uint32_t 折叠后的部分和
+ */
+static inline uint32_t checksum_fold64(uint64_t sum) {
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  sum = (sum & 0xffffffff) + (sum >> 32);
+  return (uint32_t)sum;
+}
+
+/**
+ * @brief 内部函数，逐个32位字累加到64位累加和中，处理不足4字节的尾部
+ * 每次最多加2^32-1，在BUF_MAX_LEN范围内不会溢出
+ *
+ * @param data 数据
+ * @param len 长度
+ * @param sum 64位累加和
+ * @return uint64_t 新的累加和
+ */
+static inline uint64_t checksum_add_tail(const uint8_t *data, size_t len,
+                                         uint64_t sum) {
+  uint32_t w32;
+  for (; len >= 4 * sizeof(uint32_t); len -= 4 * sizeof(uint32_t)) {
+    for (int i = 0; i < 4; i++) {
+      memcpy(&w32, data, sizeof(uint32_t));
+      sum += w32;
+      data += sizeof(uint32_t);
+    }
+  }
+  for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t)) {
+    memcpy(&w32, data, sizeof(uint32_t));
+    sum += w32;
+    data += sizeof(uint32_t);
+  }
+  uint16_t w16 = 0;
+  if (len >= sizeof(uint16_t)) {
+    memcpy(&w16, data, sizeof(uint16_t));
+    sum += w16;
+    data += sizeof(uint16_t);
+    len -= sizeof(uint16_t);
+  }
+  if (len) { // 奇数长度，最后一个字节补0凑成一个16位字
+    w16 = 0;
+    memcpy(&w16, data, sizeof(uint8_t));
+    sum += w16;
+  }
+  return sum;
+}
+
+/**
+ * @brief 可移植的实现，64位累加
+ */
+static uint32_t checksum_partial_scalar(const void *data, size_t len,
+                                        uint32_t sum) {
+  return checksum_fold64(checksum_add_tail(data, len, sum));
+}
+
+/**
+ * @brief 可移植的拷贝并累加实现，每个32位字读一次，同时写出并累加
+ */
+static uint32_t checksum_copy_scalar(void *dst, const void *src, size_t len,
+                                     uint32_t sum) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  uint64_t total = sum;
+  uint32_t w32;
+  for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t)) {
+    memcpy(&w32, s, sizeof(uint32_t));
+    memcpy(d, &w32, sizeof(uint32_t));
+    total += w32;
+    s += sizeof(uint32_t);
+    d += sizeof(uint32_t);
+  }
+  memcpy(d, s, len);
+  return checksum_fold64(checksum_add_tail(s, len, total));
+}
+
+#ifdef CHECKSUM_X86
+/**
+ * @brief SSE2实现，每次处理16字节，32位字零扩展后按64位通道累加
+ */
+__attribute__((target("sse2"))) static uint32_t
+checksum_partial_sse2(const void *data, size_t len, uint32_t sum) {
+  const uint8_t *p = data;
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero;
+  for (; len >= 16; len -= 16, p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+  uint64_t total = (uint64_t)sum + checksum_fold64(lanes[0]) +
+                   checksum_fold64(lanes[1]);
+  return checksum_fold64(checksum_add_tail(p, len, total));
+}
+
+/**
+ * @brief SSE2拷贝并累加实现，数据在寄存器中同时写出和累加
+ */
+__attribute__((target("sse2"))) static uint32_t
+checksum_copy_sse2(void *dst, const void *src, size_t len, uint32_t sum) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero;
+  for (; len >= 16; len -= 16, s += 16, d += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)s);
+    _mm_storeu_si128((__m128i *)d, v);
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+  uint64_t total = (uint64_t)sum + checksum_fold64(lanes[0]) +
+                   checksum_fold64(lanes[1]);
+  memcpy(d, s, len);
+  return checksum_fold64(checksum_add_tail(s, len, total));
+}
+
+/**
+ * @brief AVX2实现，每次处理64字节，用四个累加器隐藏加法延迟
+ */
+__attribute__((target("avx2"))) static uint32_t
+checksum_partial_avx2(const void *data, size_t len, uint32_t sum) {
+  const uint8_t *p = data;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+  for (; len >= 64; len -= 64, p += 64) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(v1, zero));
+    acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(v1, zero));
+  }
+  if (len >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    len -= 32;
+    p += 32;
+  }
+  __m256i acc = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1),
+                                 _mm256_add_epi64(acc2, acc3));
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  uint64_t total = sum;
+  for (int i = 0; i < 4; i++)
+    total += checksum_fold64(lanes[i]);
+  return checksum_fold64(checksum_add_tail(p, len, total));
+}
+
+/**
+ * @brief AVX2拷贝并累加实现，每次处理32字节
+ */
+__attribute__((target("avx2"))) static uint32_t
+checksum_copy_avx2(void *dst, const void *src, size_t len, uint32_t sum) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero;
+  for (; len >= 32; len -= 32, s += 32, d += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)s);
+    _mm256_storeu_si256((__m256i *)d, v);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+  uint64_t total = sum;
+  for (int i = 0; i < 4; i++)
+    total += checksum_fold64(lanes[i]);
+  memcpy(d, s, len);
+  return checksum_fold64(checksum_add_tail(s, len, total));
+}
+#endif
+
+/**
+ * @brief 所有实现，按优先级从低到高排列
+ *
+ */
+static const checksum_impl_t checksum_impls[] = {
+    {"scalar", checksum_partial_scalar, checksum_copy_scalar},
+#ifdef CHECKSUM_X86
+    {"sse2", checksum_partial_sse2, checksum_copy_sse2},
+    {"avx2", checksum_partial_avx2, checksum_copy_avx2},
+#endif
+};
+
+/**
+ * @brief 获取当前CPU支持的所有实现
+ *
+ * @param list 输出实现数组，最后一个是默认使用的实现
+ * @return size_t 实现数量
+ */
+size_t checksum_impl_list(const checksum_impl_t **list) {
+  size_t n = 1;
+#ifdef CHECKSUM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    n = 2;
+  if (n == 2 && __builtin_cpu_supports("avx2"))
+    n = 3;
+#endif
+  *list = checksum_impls;
+  return n;
+}
+
+static uint32_t checksum_partial_select(const void *data, size_t len,
+                                        uint32_t sum);
+static uint32_t checksum_copy_select(void *dst, const void *src, size_t len,
+                                     uint32_t sum);
+static checksum_partial_t checksum_partial_impl = checksum_partial_select;
+static checksum_copy_t checksum_copy_impl = checksum_copy_select;
+
+/**
+ * @brief 内部函数，选择CPU支持的最快实现
+ */
+static void checksum_select() {
+  const checksum_impl_t *list;
+  size_t n = checksum_impl_list(&list);
+  checksum_partial_impl = list[n - 1].partial;
+  checksum_copy_impl = list[n - 1].copy;
+}
+
+/**
+ * @brief 内部函数，首次调用时选择实现
+ */
+static uint32_t checksum_partial_select(const void *data, size_t len,
+                                        uint32_t sum) {
+  checksum_select();
+  return checksum_partial_impl(data, len, sum);
+}
+
+/**
+ * @brief 内部函数，首次调用时选择实现
+ */
+static uint32_t checksum_copy_select(void *dst, const void *src, size_t len,
+                                     uint32_t sum) {
+  checksum_select();
+  return checksum_copy_impl(dst, src, len, sum);
+}
+
+/**
+ * @brief 累加数据的校验和部分和
+ *
+ * @param data 数据
+ * @param len 长度，可以是BUF_MAX_LEN以内的任意长度
+ * @param sum 之前的部分和，首段为0
+ * @return uint32_t 新的部分和，用checksum_fold得到校验和
+ */
+uint32_t checksum_partial(const void *data, size_t len, uint32_t sum) {
+  return checksum_partial_impl(data, len, sum);
+}
+
+/**
+ * @brief 把数据拷贝到dst，同时累加其部分和，省去发送时对数据的第二次遍历
+ *
+ * @param dst 目的地址，不能与src重叠
+ * @param src 源地址
+ * @param len 长度
+ * @param sum 之前的部分和，dst在报文中的偏移必须是偶数
+ * @return uint32_t 新的部分和
+ */
+uint32_t checksum_copy(void *dst, const void *src, size_t len, uint32_t sum) {
+  return checksum_copy_impl(dst, src, len, sum);
+}
+
+/**
+ * @brief 累加传输层伪首部的部分和，直接按字段计算，不必在报文前构造伪首部
+ *
+ * @param src_ip 源ip地址
+ * @param dst_ip 目的ip地址
+ * @param protocol 上层协议号
+ * @param len 传输层报文长度（首部加数据）
+ * @param sum 之前的部分和
+ * @return uint32_t 新的部分和
+ */
+uint32_t checksum_pseudo(const uint8_t *src_ip, const uint8_t *dst_ip,
+                         uint8_t protocol, uint16_t len, uint32_t sum) {
+  uint64_t total = sum;
+  uint32_t ip;
+  memcpy(&ip, src_ip, sizeof(uint32_t));
+  total += ip;
+  memcpy(&ip, dst_ip, sizeof(uint32_t));
+  total += ip;
+  total += swap16((uint16_t)protocol) + swap16(len); // 置0字节与协议号、总长度
+  return checksum_fold64(total);
+}
+
+/**
+ * @brief 把部分和折叠为16位并取反，得到可直接写入报文的校验和
+ *
+ * @param sum 部分和
+ * @return uint16_t 校验和，与报文中的字节序相同
+ */
+uint16_t checksum_fold(uint32_t sum) {
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t)~sum;
+}
+
+/**
+ * @brief 计算16位校验和
+ *
+ * @param buf 要计算的数据包
+ * @param len 要计算的长度
+ * @return uint16_t 校验和
+ */
+uint16_t checksum16(uint16_t *buf, size_t len) {
+  return swap16(checksum_fold(checksum_partial(buf, len, 0)));
+}
+
+/**
+ * @brief 报文中一个16位字从from改为to后，增量更新校验和（RFC 1624 式3），
+ * 无需重新累加整个报文。参数与返回值都与报文中的字节序相同
+ *
+ * @param check 原校验和
+ * @param from 原来的16位字
+ * @param to 新的16位字
+ * @return uint16_t 新的校验和
+ */
+uint16_t checksum_update16(uint16_t check, uint16_t from, uint16_t to) {
+  // HC' = ~(~HC + ~m + m')
+  return checksum_fold((uint16_t)~check + (uint16_t)~from + (uint32_t)to);
+}
+
+/**
+ * @brief 报文中一个32位字（如seq、ack、IP地址）改变后，增量更新校验和
+ *
+ * @param check 原校验和
+ * @param from 原来的32位字，按内存中的字节序
+ * @param to 新的32位字，按内存中的字节序
+ * @return uint16_t 新的校验和
+ */
+uint16_t checksum_update32(uint16_t check, uint32_t from, uint32_t to) {
+  uint32_t sum = (uint16_t)~check;
+  sum += (uint16_t)~from + (uint32_t)(uint16_t)~(from >> 16);
+  sum += (to & 0xffff) + (to >> 16);
+  return checksum_fold(sum);
+}
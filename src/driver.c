@@ -1,5 +1,16 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sendmmsg
+#endif
 #include "driver.h"
+
+#ifdef DRIVER_PCAP
 #include <pcap.h>
+#ifdef __linux__
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #ifdef _WIN32
 #include <tchar.h>
@@ -28,6 +39,22 @@ BOOL LoadNpcapDlls() {
 pcap_t *pcap;
 char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
+/**
+ * @brief 发送队列，driver_send只持有帧的引用，攒够一批或超过延迟上限时一起发出。
+ * Linux上用绑定到同一网卡的原始socket调用一次sendmmsg，Windows上用Npcap的
+ * 发送队列，都不可用时退化为逐个pcap_sendpacket
+ *
+ */
+static buf_t tx_queue[DRIVER_TX_BATCH];
+static int tx_pending;      // 队列中的帧数
+static uint64_t tx_first_ms; // 队列中最早的帧入队的时间
+#ifdef __linux__
+static int tx_fd = -1;
+#endif
+#ifdef _WIN32
+static pcap_send_queue *tx_sendqueue;
+#endif
+
 /**
  * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
  *
@@ -143,8 +170,64 @@ int driver_open() {
     fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
     return -1;
   }
+
+  // 批量发送的通道，打开失败时仍可逐个pcap_sendpacket
+#ifdef __linux__
+  struct sockaddr_ll sll = {0};
+  sll.sll_family = AF_PACKET;
+  sll.sll_ifindex = if_nametoindex(if_name);
+  tx_fd = socket(AF_PACKET, SOCK_RAW, 0);
+  if (tx_fd >= 0 && bind(tx_fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    close(tx_fd);
+    tx_fd = -1;
+  }
+#endif
+#ifdef _WIN32
+  tx_sendqueue = pcap_sendqueue_alloc(
+      DRIVER_TX_BATCH * (sizeof(struct pcap_pkthdr) + BUF_SMALL_LEN));
+#endif
   return 0;
 }
+typedef struct driver_burst { // 一次批量接收的状态，传给pcap_dispatch的回调
+  buf_t *bufs;                  // 存放收到的帧
+  int cnt;                      // 已收到的帧数
+} driver_burst_t;
+
+/**
+ * @brief 内部函数，pcap_dispatch的回调，把一个帧拷贝到下一个buf中
+ *
+ * @param user 批量接收的状态
+ * @param pkt_hdr 帧的pcap头部
+ * @param pkt_data 帧数据
+ */
+static void driver_burst_handler(u_char *user,
+                                 const struct pcap_pkthdr *pkt_hdr,
+                                 const u_char *pkt_data) {
+  driver_burst_t *burst = (driver_burst_t *)user;
+  buf_t *buf = &burst->bufs[burst->cnt];
+  if (buf_init(buf, pkt_hdr->caplen) < 0) // 缓冲池耗尽时丢弃该帧
+    return;
+  memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+  burst->cnt++;
+}
+
+/**
+ * @brief 试图从网卡批量接收数据包，一次系统调用收取缓冲区中已有的多个帧
+ *
+ * @param bufs 收到的数据包，至少有n个
+ * @param n 最多接收的数量
+ * @return int 收到的数据包数量，未收到为0，错误为-1
+ */
+int driver_recv_burst(buf_t *bufs, int n) {
+  driver_burst_t burst = {bufs, 0};
+  int ret = pcap_dispatch(pcap, n, driver_burst_handler, (u_char *)&burst);
+  if (ret < 0 && ret != PCAP_ERROR_BREAK) {
+    fprintf(stderr, "Error in driver_recv_burst.\n%s.\n", pcap_geterr(pcap));
+    return -1;
+  }
+  return burst.cnt;
+}
+
 /**
  * @brief 试图从网卡接收数据包
  *
@@ -152,35 +235,127 @@ int driver_open() {
  * @return int 数据包的长度，未收到为0，错误为-1
  */
 int driver_recv(buf_t *buf) {
-  struct pcap_pkthdr *pkt_hdr;
-  const uint8_t *pkt_data;
-  int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
-  if (ret == 0)
-    return 0;
-  if (ret == 1) {
-    memcpy(buf->data, pkt_data, pkt_hdr->len);
-    buf->len = pkt_hdr->len;
-    return pkt_hdr->len;
-  }
-  fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
-  return -1;
+  int ret = driver_recv_burst(buf, 1);
+  return ret > 0 ? (int)buf->len : ret;
 }
 /**
- * @brief 使用网卡发送一个数据包
+ * @brief 使用网卡发送一个数据包，先放入发送队列，队列满时整批发出
  *
- * @param buf 要发送的数据包
+ * @param buf 要发送的数据包，队列只持有引用，调用者之后可以照常复用或释放
  * @return int 成功为0，失败为-1
  */
 int driver_send(buf_t *buf) {
-  if (pcap_sendpacket(pcap, buf->data, buf->len) == -1) {
-    fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
-    return -1;
-  }
+  if (tx_pending == 0)
+    tx_first_ms = net_clock_ms();
+  buf_ref(&tx_queue[tx_pending++], buf, 0);
+  if (tx_pending >= DRIVER_TX_BATCH)
+    return driver_flush();
+  return 0;
+}
 
+/**
+ * @brief 内部函数，逐个发送队列中的帧
+ *
+ * @param start 起始位置
+ * @return int 成功为0，失败为-1
+ */
+static int driver_send_each(int start) {
+  int ret = 0;
+  for (int i = start; i < tx_pending; i++)
+    if (pcap_sendpacket(pcap, tx_queue[i].data, tx_queue[i].len) == -1) {
+      fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
+      ret = -1;
+    }
+  return ret;
+}
+
+/**
+ * @brief 把发送队列中的所有帧一次发出
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_flush() {
+  if (tx_pending == 0)
+    return 0;
+  int ret = 0;
+#if defined(__linux__)
+  if (tx_fd >= 0) {
+    struct mmsghdr msgs[DRIVER_TX_BATCH];
+    struct iovec iovs[DRIVER_TX_BATCH];
+    memset(msgs, 0, sizeof(struct mmsghdr) * tx_pending);
+    for (int i = 0; i < tx_pending; i++) {
+      iovs[i].iov_base = tx_queue[i].data;
+      iovs[i].iov_len = tx_queue[i].len;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(tx_fd, msgs, tx_pending, 0);
+    if (sent < 0)
+      sent = 0;
+    ret = driver_send_each(sent); // 未发出的部分逐个补发
+  } else
+    ret = driver_send_each(0);
+#elif defined(_WIN32)
+  if (tx_sendqueue) {
+    struct pcap_pkthdr hdr = {0};
+    tx_sendqueue->len = 0;
+    for (int i = 0; i < tx_pending; i++) {
+      hdr.caplen = hdr.len = tx_queue[i].len;
+      pcap_sendqueue_queue(tx_sendqueue, &hdr, tx_queue[i].data);
+    }
+    if (pcap_sendqueue_transmit(pcap, tx_sendqueue, 0) < tx_sendqueue->len) {
+      fprintf(stderr, "Error in driver_flush.\n%s.\n", pcap_geterr(pcap));
+      ret = -1;
+    }
+  } else
+    ret = driver_send_each(0);
+#else
+  ret = driver_send_each(0);
+#endif
+  for (int i = 0; i < tx_pending; i++)
+    buf_free(&tx_queue[i]);
+  tx_pending = 0;
+  return ret;
+}
+
+/**
+ * @brief 由net_poll调用，发送队列攒够一批或最早的帧等待超过延迟上限时发出
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_tx_poll() {
+  if (driver_tx_due(tx_pending, tx_first_ms))
+    return driver_flush();
   return 0;
 }
+
+/**
+ * @brief 获取接收方向可用于epoll等待的fd，由net_wait在空闲时阻塞其上
+ *
+ * @return int fd，不支持时为-1
+ */
+int driver_fd() {
+#ifdef _WIN32
+  return -1;
+#else
+  return pcap_get_selectable_fd(pcap);
+#endif
+}
+
 /**
  * @brief 关闭网卡
  *
  */
-void driver_close() { pcap_close(pcap); }
+void driver_close() {
+  driver_flush();
+#ifdef __linux__
+  if (tx_fd >= 0)
+    close(tx_fd);
+#endif
+#ifdef _WIN32
+  if (tx_sendqueue)
+    pcap_sendqueue_destroy(tx_sendqueue);
+#endif
+  pcap_close(pcap);
+}
+#endif
@@ -0,0 +1,375 @@
+#include "driver.h"
+
+#ifdef DRIVER_AF_PACKET
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// xn: 接收用 TPACKET_V3 环形缓冲区，内核把帧成批写入块中，一个块交给用户态后
+// 其中所有帧直接在环上解析，处理完整个块再归还内核；
+// 发送用 TPACKET_V2 环形缓冲区，帧写入槽位后不立即发送，driver_flush 时用一次
+// sendto 通知内核把所有已就绪的槽位发出。
+// 一个 socket 只能选用一种 TPACKET 版本，所以收发各用一个 socket
+
+static int rx_fd = -1, tx_fd = -1;
+static uint8_t *rx_ring, *tx_ring;
+static int rx_block;        // 当前正在处理的接收块
+static int rx_busy;         // 当前接收块已交给用户态
+static uint32_t rx_left;    // 当前接收块中尚未交付的帧数
+static uint8_t *rx_pkt;     // 当前接收块中下一个帧的头部
+static size_t tx_ring_size; // 发送环形缓冲区总大小
+static int tx_frame_nr;     // 发送槽位数
+static int tx_frame;        // 下一个可用的发送槽位
+static int tx_pending;      // 已写入槽位但尚未通知内核的帧数
+static uint64_t tx_first_ms; // 最早的未通知帧写入的时间
+
+/**
+ * @brief 内部函数，根据ip进行前缀匹配，选取最长前缀匹配的网卡。
+ * 设置了环境变量 NET_IF 时直接使用其指定的网卡，便于在 veth 对上测试
+ *
+ * @param ip ip地址
+ * @param if_name 出口参数，选取的网卡名
+ * @return int 成功为0，失败为-1
+ */
+static int driver_find(uint8_t *ip, char *if_name) {
+  const char *env = getenv("NET_IF");
+  if (env && *env) {
+    snprintf(if_name, IF_NAMESIZE, "%s", env);
+    return 0;
+  }
+
+  struct ifaddrs *ifaddr, *ifa;
+  uint8_t max_match = 0;
+  if (getifaddrs(&ifaddr) == -1) {
+    perror("Error in getifaddrs");
+    return -1;
+  }
+  for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_INET ||
+        ifa->ifa_netmask == NULL)
+      continue;
+    uint8_t *addr =
+        (uint8_t *)&((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+    uint8_t *mask =
+        (uint8_t *)&((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr.s_addr;
+    uint32_t mask_all = 0xffffffff;
+    uint8_t match = ip_prefix_match(ip, addr);
+    if (match < ip_prefix_match((uint8_t *)&mask_all, mask))
+      continue; // 不在同一网段
+    if (match == 32) {
+      fprintf(stderr, "Error, interface %s have the same ip %s with me.\n",
+              ifa->ifa_name, iptos(ip));
+      freeifaddrs(ifaddr);
+      return -1;
+    }
+    if (match > max_match) {
+      max_match = match;
+      snprintf(if_name, IF_NAMESIZE, "%s", ifa->ifa_name);
+    }
+  }
+  freeifaddrs(ifaddr);
+  if (max_match == 0) {
+    fprintf(stderr, "Error, no interface found.\n");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 内部函数，创建绑定到网卡的AF_PACKET socket并映射环形缓冲区
+ *
+ * @param ifindex 网卡编号
+ * @param version TPACKET版本
+ * @param ring PACKET_RX_RING 或 PACKET_TX_RING
+ * @param req 环形缓冲区参数
+ * @param req_len 参数长度
+ * @param size 环形缓冲区总大小
+ * @param map 出口参数，映射的地址
+ * @return int socket，失败为-1
+ */
+static int driver_ring_open(int ifindex, int version, int ring, void *req,
+                            socklen_t req_len, size_t size, uint8_t **map) {
+  int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (fd < 0) {
+    perror("Error in socket(AF_PACKET)");
+    return -1;
+  }
+  if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) <
+          0 ||
+      setsockopt(fd, SOL_PACKET, ring, req, req_len) < 0) {
+    perror("Error in setsockopt(PACKET_RING)");
+    close(fd);
+    return -1;
+  }
+  *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (*map == MAP_FAILED) {
+    perror("Error in mmap");
+    close(fd);
+    return -1;
+  }
+  struct sockaddr_ll sll = {0};
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(ETH_P_ALL);
+  sll.sll_ifindex = ifindex;
+  if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+    perror("Error in bind");
+    munmap(*map, size);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open() {
+  char if_name[IF_NAMESIZE];
+  if (driver_find(net_if_ip, if_name) < 0) {
+    fprintf(stderr, "Error in driver find.\n");
+    return -1;
+  }
+  int ifindex = if_nametoindex(if_name);
+  if (ifindex == 0) {
+    fprintf(stderr, "Error in if_nametoindex: %s.\n", if_name);
+    return -1;
+  }
+  printf("Using interface %s (AF_PACKET), my ip is %s.\n", if_name,
+         iptos(net_if_ip));
+
+  struct tpacket_req3 rx_req = {0};
+  rx_req.tp_block_size = DRIVER_RING_BLOCK_SIZE;
+  rx_req.tp_block_nr = DRIVER_RING_BLOCK_NR;
+  rx_req.tp_frame_size = DRIVER_RING_FRAME_SIZE;
+  rx_req.tp_frame_nr =
+      DRIVER_RING_BLOCK_SIZE / DRIVER_RING_FRAME_SIZE * DRIVER_RING_BLOCK_NR;
+  rx_req.tp_retire_blk_tov = 1; // 块未满时最多等待1毫秒就交给用户态
+  rx_fd = driver_ring_open(ifindex, TPACKET_V3, PACKET_RX_RING, &rx_req,
+                           sizeof(rx_req),
+                           (size_t)DRIVER_RING_BLOCK_SIZE * DRIVER_RING_BLOCK_NR,
+                           &rx_ring);
+  if (rx_fd < 0)
+    return -1;
+
+  struct tpacket_req tx_req = {0};
+  tx_req.tp_block_size = DRIVER_RING_BLOCK_SIZE;
+  tx_req.tp_block_nr = DRIVER_TX_FRAME_NR * DRIVER_RING_FRAME_SIZE /
+                       DRIVER_RING_BLOCK_SIZE;
+  if (tx_req.tp_block_nr == 0)
+    tx_req.tp_block_nr = 1;
+  tx_req.tp_frame_size = DRIVER_RING_FRAME_SIZE;
+  tx_req.tp_frame_nr = tx_req.tp_block_nr *
+                       (DRIVER_RING_BLOCK_SIZE / DRIVER_RING_FRAME_SIZE);
+  tx_frame_nr = tx_req.tp_frame_nr;
+  tx_ring_size = (size_t)tx_req.tp_block_size * tx_req.tp_block_nr;
+  tx_fd = driver_ring_open(ifindex, TPACKET_V2, PACKET_TX_RING, &tx_req,
+                           sizeof(tx_req), tx_ring_size, &tx_ring);
+  if (tx_fd < 0)
+    return -1;
+
+  // 协议栈使用自己的MAC地址，需要混杂模式才能收到发给它的帧
+  struct packet_mreq mreq = {0};
+  mreq.mr_ifindex = ifindex;
+  mreq.mr_type = PACKET_MR_PROMISC;
+  if (setsockopt(rx_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+                 sizeof(mreq)) < 0) {
+    perror("Error in setsockopt(PACKET_MR_PROMISC)");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 内部函数，与pcap驱动的BPF过滤条件相同：只接收发给本机MAC或广播的帧，
+ * 并排除本机自己发出的帧
+ *
+ * @param frame 帧数据
+ * @param len 帧长度
+ * @return int 接收为1，丢弃为0
+ */
+static int driver_accept(const uint8_t *frame, size_t len) {
+  static const uint8_t mac[NET_MAC_LEN] = NET_IF_MAC;
+  static const uint8_t broadcast[NET_MAC_LEN] = {0xff, 0xff, 0xff,
+                                                 0xff, 0xff, 0xff};
+  if (len < 2 * NET_MAC_LEN)
+    return 0;
+  if (memcmp(frame, mac, NET_MAC_LEN) &&
+      memcmp(frame, broadcast, NET_MAC_LEN))
+    return 0;
+  return memcmp(frame + NET_MAC_LEN, mac, NET_MAC_LEN) != 0;
+}
+
+/**
+ * @brief 内部函数，补全本机其他程序发出、由网卡卸载校验和的帧（如veth上）。
+ * 这类帧的传输层校验和字段中只有伪首部的部分和，按网卡的做法累加整个
+ * 传输层报文后取反即可
+ *
+ * @param frame 帧数据
+ * @param len 帧长度
+ */
+static void driver_csum_fixup(uint8_t *frame, size_t len) {
+  if (len < ETH_HLEN + 20 || frame[12] != 0x08 || frame[13] != 0x00)
+    return; // 只处理IPv4
+  uint8_t *ip = frame + ETH_HLEN;
+  size_t ihl = (ip[0] & 0x0f) * 4;
+  size_t total = (ip[2] << 8) | ip[3];
+  if (total > len - ETH_HLEN || total < ihl)
+    return;
+  size_t field;
+  if (ip[9] == NET_PROTOCOL_TCP)
+    field = 16;
+  else if (ip[9] == NET_PROTOCOL_UDP)
+    field = 6;
+  else
+    return;
+  if (total - ihl < field + sizeof(uint16_t))
+    return;
+  uint16_t check = checksum_fold(checksum_partial(ip + ihl, total - ihl, 0));
+  if (check == 0 && ip[9] == NET_PROTOCOL_UDP)
+    check = 0xffff;
+  memcpy(ip + ihl + field, &check, sizeof(uint16_t));
+}
+
+/**
+ * @brief 试图从网卡批量接收数据包。帧不拷贝，buf直接借用环形缓冲区，
+ * 在下一次调用时才归还内核，所以调用者必须在此之前处理完本批的帧
+ *
+ * @param bufs 收到的数据包，至少有n个
+ * @param n 最多接收的数量
+ * @return int 收到的数据包数量，未收到为0
+ */
+int driver_recv_burst(buf_t *bufs, int n) {
+  struct tpacket_block_desc *pbd =
+      (struct tpacket_block_desc *)(rx_ring +
+                                    (size_t)rx_block * DRIVER_RING_BLOCK_SIZE);
+  if (rx_busy && rx_left == 0) { // 上一批已处理完毕，整块归还内核
+    __atomic_store_n(&pbd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    rx_busy = 0;
+    rx_block = (rx_block + 1) % DRIVER_RING_BLOCK_NR;
+    pbd = (struct tpacket_block_desc *)(rx_ring + (size_t)rx_block *
+                                                      DRIVER_RING_BLOCK_SIZE);
+  }
+  if (!rx_busy) {
+    if (!(__atomic_load_n(&pbd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER))
+      return 0;
+    rx_busy = 1;
+    rx_left = pbd->hdr.bh1.num_pkts;
+    rx_pkt = (uint8_t *)pbd + pbd->hdr.bh1.offset_to_first_pkt;
+  }
+
+  int cnt = 0;
+  while (cnt < n && rx_left) {
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)rx_pkt;
+    uint8_t *frame = rx_pkt + hdr->tp_mac;
+    rx_pkt += hdr->tp_next_offset;
+    rx_left--;
+    if (!driver_accept(frame, hdr->tp_snaplen))
+      continue;
+    if (hdr->tp_status & TP_STATUS_CSUMNOTREADY)
+      driver_csum_fixup(frame, hdr->tp_snaplen);
+    buf_wrap(&bufs[cnt++], frame, hdr->tp_snaplen);
+  }
+  return cnt;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+int driver_recv(buf_t *buf) {
+  int ret = driver_recv_burst(buf, 1);
+  return ret > 0 ? (int)buf->len : ret;
+}
+
+/**
+ * @brief 把一个数据包写入发送环形缓冲区，等到driver_flush时才真正发出
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf) {
+  size_t offset = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+  if (buf->len > DRIVER_RING_FRAME_SIZE - offset) {
+    fprintf(stderr, "Error in driver_send: frame too long %zu.\n", buf->len);
+    return -1;
+  }
+  struct tpacket2_hdr *hdr =
+      (struct tpacket2_hdr *)(tx_ring +
+                              (size_t)tx_frame * DRIVER_RING_FRAME_SIZE);
+  if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+      TP_STATUS_AVAILABLE) {
+    driver_flush(); // 环已满，先让内核发出已就绪的帧
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+        TP_STATUS_AVAILABLE) {
+      fprintf(stderr, "Error in driver_send: tx ring full.\n");
+      return -1;
+    }
+  }
+  memcpy((uint8_t *)hdr + offset, buf->data, buf->len);
+  hdr->tp_len = buf->len;
+  __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+  tx_frame = (tx_frame + 1) % tx_frame_nr;
+  if (tx_pending++ == 0)
+    tx_first_ms = net_clock_ms();
+  if (tx_pending >= DRIVER_TX_BATCH)
+    return driver_flush();
+  return 0;
+}
+
+/**
+ * @brief 通知内核发出发送环形缓冲区中所有已就绪的帧，一批只需一次系统调用
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_flush() {
+  if (tx_pending == 0)
+    return 0;
+  tx_pending = 0;
+  if (sendto(tx_fd, NULL, 0, 0, NULL, 0) < 0) {
+    perror("Error in driver_flush");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 由net_poll调用，攒够一批或最早的帧等待超过延迟上限时通知内核发出
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_tx_poll() {
+  if (driver_tx_due(tx_pending, tx_first_ms))
+    return driver_flush();
+  return 0;
+}
+
+/**
+ * @brief 获取接收方向可用于epoll等待的fd，由net_wait在空闲时阻塞其上
+ *
+ * @return int fd，接收环有块交给用户态时可读
+ */
+int driver_fd() { return rx_fd; }
+
+/**
+ * @brief 关闭网卡
+ *
+ */
+void driver_close() {
+  driver_flush();
+  munmap(rx_ring, (size_t)DRIVER_RING_BLOCK_SIZE * DRIVER_RING_BLOCK_NR);
+  munmap(tx_ring, tx_ring_size);
+  close(rx_fd);
+  close(tx_fd);
+}
+#endif
@@ -0,0 +1,291 @@
+#include "driver.h"
+
+#ifdef DRIVER_LOOPBACK
+#include <sys/mman.h>
+
+// xn: 回环驱动把两个协议栈实例背靠背连在一起，不经过任何网卡。
+// 协议栈的状态都是全局变量，一个进程只能有一个实例，所以两个实例分别运行在
+// fork 出的父子进程中：driver_loopback_pair 在 fork 之前映射一块共享内存，
+// 其中有两个方向的单生产者单消费者环，只靠原子的 head/tail 同步，不需要锁。
+// 发送方把帧写入槽位，driver_flush 时才发布 head，与 AF_PACKET 发送环一样成批；
+// 接收方的 buf 直接借用槽位，下一次接收时才归还 tail。
+// 发送时可以按 driver_loopback_side 给定的参数模拟丢包、乱序和时延，
+// 以及带宽受限的瓶颈链路：帧按链路速率依次发出，发不完的在队列中排队，
+// 队列满了就丢弃（尾部丢弃），送达时间精确到微秒
+
+typedef struct loopback_slot {
+  uint64_t due_us; // 送达时间，接收方在此之前不取出
+  uint32_t len;
+  uint8_t data[DRIVER_LOOPBACK_FRAME_SIZE];
+} loopback_slot_t;
+
+typedef struct loopback_ring {
+  uint32_t head; // 生产者已发布的位置，下标自由增长，取模得到槽位
+  uint8_t pad0[60];
+  uint32_t tail; // 消费者已归还的位置，与head分处不同的缓存行
+  uint8_t pad1[60];
+  loopback_slot_t slots[DRIVER_LOOPBACK_RING_SIZE];
+} loopback_ring_t;
+
+/**
+ * @brief 回环驱动发送方向的统计计数
+ *
+ */
+driver_loopback_stats_t driver_loopback_stats;
+
+static loopback_ring_t *rings; // 共享内存中的两个环，rings[i]由第i端发送
+static loopback_ring_t *tx, *rx;
+static int side = -1;
+static driver_loopback_impair_t impair;
+static unsigned int seed;      // 损伤模拟的随机数种子，两端不同且可复现
+static uint32_t tx_head;       // 已写入但尚未发布的位置
+static uint32_t rx_next;       // 下一个待交付的位置
+static int tx_pending;         // 已写入但尚未发布的帧数
+static uint64_t tx_first_ms;   // 最早的未发布帧写入的时间
+static buf_t held;             // 模拟乱序时被扣留的帧
+static int held_valid;         // 是否有被扣留的帧
+static uint64_t held_ms;       // 帧被扣留的时间
+static uint64_t held_due;      // 被扣留的帧原本的送达时间
+static uint64_t link_free_us;  // 模拟的瓶颈链路发完已排队的帧的时间
+
+/**
+ * @brief 创建一对相连的回环端点，须在fork之前调用，父子进程才能共享
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_loopback_pair() {
+  if (rings)
+    return 0;
+  rings = mmap(NULL, 2 * sizeof(loopback_ring_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (rings == MAP_FAILED) {
+    rings = NULL;
+    perror("Error in mmap");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 选择本进程使用的端点及发送时施加的损伤，须在net_init之前调用
+ *
+ * @param s 端点编号，0或1
+ * @param imp 损伤参数，NULL为无损伤
+ */
+void driver_loopback_side(int s, const driver_loopback_impair_t *imp) {
+  side = s;
+  if (imp)
+    impair = *imp;
+  else
+    memset(&impair, 0, sizeof(impair));
+  seed = s + 1;
+}
+
+/**
+ * @brief 打开网卡，未调用driver_loopback_pair时自动创建，未选择端点时为0端
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open() {
+  if (driver_loopback_pair() < 0)
+    return -1;
+  if (side < 0)
+    driver_loopback_side(0, NULL);
+  tx = &rings[side];
+  rx = &rings[!side];
+  tx_head = __atomic_load_n(&tx->head, __ATOMIC_ACQUIRE);
+  rx_next = __atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE);
+  printf("Using loopback side %d, my ip is %s.\n", side, iptos(net_if_ip));
+  return 0;
+}
+
+/**
+ * @brief 试图从网卡批量接收数据包。buf直接借用环中的槽位，
+ * 在下一次调用时才归还，所以调用者必须在此之前处理完本批的帧
+ *
+ * @param bufs 收到的数据包，至少有n个
+ * @param n 最多接收的数量
+ * @return int 收到的数据包数量，未收到为0
+ */
+int driver_recv_burst(buf_t *bufs, int n) {
+  __atomic_store_n(&rx->tail, rx_next, __ATOMIC_RELEASE); // 归还上一批
+  uint32_t head = __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE);
+  uint64_t now = net_clock_us();
+  int cnt = 0;
+  while (cnt < n && rx_next != head) {
+    loopback_slot_t *slot =
+        &rx->slots[rx_next & (DRIVER_LOOPBACK_RING_SIZE - 1)];
+    if (slot->due_us > now)
+      break; // 环中的帧按送达时间排列，这一帧未到则后面的也未到
+    buf_wrap(&bufs[cnt++], slot->data, slot->len);
+    rx_next++;
+  }
+  return cnt;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+int driver_recv(buf_t *buf) {
+  int ret = driver_recv_burst(buf, 1);
+  return ret > 0 ? (int)buf->len : ret;
+}
+
+/**
+ * @brief 内部函数，把一个帧写入发送环的槽位，暂不发布
+ *
+ * @param buf 帧
+ * @param due_us 送达时间
+ * @return int 成功为0，环已满为-1
+ */
+static int driver_ring_put(buf_t *buf, uint64_t due_us) {
+  if (tx_head - __atomic_load_n(&tx->tail, __ATOMIC_ACQUIRE) >=
+      DRIVER_LOOPBACK_RING_SIZE) {
+    driver_loopback_stats.overflow++; // 与网卡队列溢出一样直接丢弃
+    return -1;
+  }
+  loopback_slot_t *slot = &tx->slots[tx_head & (DRIVER_LOOPBACK_RING_SIZE - 1)];
+  memcpy(slot->data, buf->data, buf->len);
+  slot->len = buf->len;
+  slot->due_us = due_us;
+  tx_head++;
+  driver_loopback_stats.sent++;
+  if (tx_pending++ == 0)
+    tx_first_ms = net_clock_ms();
+  return 0;
+}
+
+/**
+ * @brief 内部函数，放出被扣留的帧
+ *
+ */
+static void driver_release_held() {
+  driver_ring_put(&held, held_due);
+  buf_free(&held);
+  held_valid = 0;
+}
+
+/**
+ * @brief 内部函数，按概率p抽签
+ *
+ * @param p 概率
+ * @return int 抽中为1
+ */
+static inline int driver_chance(double p) {
+  return p > 0 && rand_r(&seed) < p * RAND_MAX;
+}
+
+/**
+ * @brief 内部函数，模拟帧经过瓶颈链路，算出它离开链路的时间
+ *
+ * @param len 帧长
+ * @param now 当前时间，微秒
+ * @return uint64_t 离开链路的时间，队列已满丢弃时为0
+ */
+static uint64_t driver_link_send(size_t len, uint64_t now) {
+  if (link_free_us < now)
+    link_free_us = now;
+  uint32_t limit =
+      impair.queue_bytes ? impair.queue_bytes : DRIVER_LOOPBACK_QUEUE_BYTES;
+  // 链路速率为 rate_mbps 比特每微秒，未发完的时间折算成排队的字节数
+  uint64_t backlog = (link_free_us - now) * impair.rate_mbps / 8;
+  if (backlog + len > limit) {
+    driver_loopback_stats.queue_drops++;
+    return 0;
+  }
+  link_free_us += (len * 8 + impair.rate_mbps - 1) / impair.rate_mbps;
+  driver_loopback_stats.queued++;
+  driver_loopback_stats.queue_delay_us += link_free_us - now;
+  return link_free_us;
+}
+
+/**
+ * @brief 把一个数据包写入发送环，按损伤参数可能丢弃、推迟或扣留，
+ * 等到driver_flush时才对端可见
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf) {
+  if (buf->len > DRIVER_LOOPBACK_FRAME_SIZE) {
+    fprintf(stderr, "Error in driver_send: frame too long %zu.\n", buf->len);
+    return -1;
+  }
+  if (driver_chance(impair.loss)) {
+    driver_loopback_stats.lost++;
+    return 0;
+  }
+  // 两端的时钟各自按轮缓存，不模拟时延和瓶颈时立即送达，免得因时钟差多等一轮
+  uint64_t due_us = 0;
+  if (impair.rate_mbps) {
+    due_us = driver_link_send(buf->len, net_clock_us());
+    if (!due_us)
+      return 0;
+  }
+  if (impair.delay_ms)
+    due_us = (due_us ? due_us : net_clock_us()) + impair.delay_ms * 1000;
+  if (!held_valid && driver_chance(impair.reorder)) {
+    buf_ref(&held, buf, 0); // 扣留到下一个帧之后再放出
+    held_valid = 1;
+    held_ms = net_clock_ms();
+    held_due = due_us;
+    driver_loopback_stats.reordered++;
+    return 0;
+  }
+  int ret = driver_ring_put(buf, due_us);
+  if (held_valid)
+    driver_release_held();
+  if (tx_pending >= DRIVER_TX_BATCH)
+    driver_flush();
+  return ret;
+}
+
+/**
+ * @brief 发布发送环中所有已写入的帧，一批只需一次原子写
+ *
+ * @return int 成功为0
+ */
+int driver_flush() {
+  if (tx_pending == 0)
+    return 0;
+  __atomic_store_n(&tx->head, tx_head, __ATOMIC_RELEASE);
+  tx_pending = 0;
+  return 0;
+}
+
+/**
+ * @brief 由net_poll调用，放出扣留过久的帧，攒够一批或最早的帧等待超过延迟上限
+ * 时发布
+ *
+ * @return int 成功为0
+ */
+int driver_tx_poll() {
+  if (held_valid && net_clock_ms() - held_ms >= DRIVER_LOOPBACK_HOLD_MS)
+    driver_release_held();
+  if (driver_tx_due(tx_pending, tx_first_ms))
+    return driver_flush();
+  return 0;
+}
+
+/**
+ * @brief 获取接收方向可用于epoll等待的fd，由net_wait在空闲时阻塞其上
+ *
+ * @return int fd，共享内存环没有可等待的fd，为-1
+ */
+int driver_fd() { return -1; }
+
+/**
+ * @brief 关闭网卡，只解除本进程的映射，对端不受影响
+ *
+ */
+void driver_close() {
+  if (held_valid)
+    driver_release_held();
+  driver_flush();
+  munmap(rings, 2 * sizeof(loopback_ring_t));
+  rings = NULL;
+}
+#endif
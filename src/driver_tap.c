@@ -0,0 +1,190 @@
+#include "driver.h"
+
+#ifdef DRIVER_TAP
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// xn: TAP 设备的另一端就是本机内核，协议栈与本机的 ping、curl、iperf 直接通信，
+// 不需要混杂模式抓包和 BPF 过滤。内核一侧的地址需另行配置，例如
+//   ip addr add 10.250.196.1/24 dev tap0
+// 设备每次 read/write 恰好对应一个帧，所以收发都成批进行：
+// 接收时一次读空设备中已就绪的帧（最多一批），发送时攒够一批再集中写出
+
+static int tap_fd = -1;
+static uint8_t rx_frames[DRIVER_RX_BURST][DRIVER_TAP_FRAME_SIZE];
+static buf_t tx_queue[DRIVER_TX_BATCH];
+static int tx_pending;       // 队列中的帧数
+static uint64_t tx_first_ms; // 队列中最早的帧入队的时间
+
+/**
+ * @brief 打开网卡，创建（或连接到已存在的）TAP设备并将其启用。
+ * 设置了环境变量 NET_IF 时使用其指定的设备名，否则为 DRIVER_TAP_NAME
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_open() {
+  struct ifreq ifr = {0};
+  const char *env = getenv("NET_IF");
+  snprintf(ifr.ifr_name, IFNAMSIZ, "%s",
+           env && *env ? env : DRIVER_TAP_NAME);
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+
+  tap_fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  if (tap_fd < 0) {
+    perror("Error in open(/dev/net/tun)");
+    return -1;
+  }
+  if (ioctl(tap_fd, TUNSETIFF, &ifr) < 0) {
+    perror("Error in ioctl(TUNSETIFF)");
+    close(tap_fd);
+    tap_fd = -1;
+    return -1;
+  }
+
+  // 启用设备，内核一侧才会收发
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0 || ioctl(fd, SIOCGIFFLAGS, &ifr) < 0) {
+    perror("Error in ioctl(SIOCGIFFLAGS)");
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  ifr.ifr_flags |= IFF_UP;
+  if (ioctl(fd, SIOCSIFFLAGS, &ifr) < 0) {
+    perror("Error in ioctl(SIOCSIFFLAGS)");
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  printf("Using interface %s (TAP), my ip is %s.\n", ifr.ifr_name,
+         iptos(net_if_ip));
+  return 0;
+}
+
+/**
+ * @brief 内部函数，只接收发给本机MAC或广播的帧，与pcap驱动的BPF过滤条件相同。
+ * 内核不会把本端写入的帧再交回来，所以无需排除自己发出的帧
+ *
+ * @param frame 帧数据
+ * @param len 帧长度
+ * @return int 接收为1，丢弃为0
+ */
+static int driver_accept(const uint8_t *frame, size_t len) {
+  static const uint8_t mac[NET_MAC_LEN] = NET_IF_MAC;
+  static const uint8_t broadcast[NET_MAC_LEN] = {0xff, 0xff, 0xff,
+                                                 0xff, 0xff, 0xff};
+  if (len < 2 * NET_MAC_LEN)
+    return 0;
+  return !memcmp(frame, mac, NET_MAC_LEN) ||
+         !memcmp(frame, broadcast, NET_MAC_LEN);
+}
+
+/**
+ * @brief 试图从网卡批量接收数据包。帧读入驱动自己的缓冲区，buf直接借用，
+ * 在下一次调用时才会被覆盖，所以调用者必须在此之前处理完本批的帧
+ *
+ * @param bufs 收到的数据包，至少有n个
+ * @param n 最多接收的数量
+ * @return int 收到的数据包数量，未收到为0，出错为-1
+ */
+int driver_recv_burst(buf_t *bufs, int n) {
+  if (n > DRIVER_RX_BURST)
+    n = DRIVER_RX_BURST;
+  int cnt = 0;
+  while (cnt < n) {
+    ssize_t len = read(tap_fd, rx_frames[cnt], DRIVER_TAP_FRAME_SIZE);
+    if (len < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+      perror("Error in driver_recv");
+      return cnt ? cnt : -1;
+    }
+    if (len == 0)
+      break;
+    if (!driver_accept(rx_frames[cnt], len))
+      continue;
+    buf_wrap(&bufs[cnt], rx_frames[cnt], len);
+    cnt++;
+  }
+  return cnt;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+int driver_recv(buf_t *buf) {
+  int ret = driver_recv_burst(buf, 1);
+  return ret > 0 ? (int)buf->len : ret;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包，先放入发送队列，队列满时整批发出
+ *
+ * @param buf 要发送的数据包，队列只持有引用，调用者之后可以照常复用或释放
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf) {
+  if (tx_pending == 0)
+    tx_first_ms = net_clock_ms();
+  buf_ref(&tx_queue[tx_pending++], buf, 0);
+  if (tx_pending >= DRIVER_TX_BATCH)
+    return driver_flush();
+  return 0;
+}
+
+/**
+ * @brief 把发送队列中的所有帧写入设备。设备的发送队列满时丢弃剩余的帧，
+ * 与网卡丢包的表现相同，由上层协议负责重传
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_flush() {
+  int ret = 0;
+  for (int i = 0; i < tx_pending; i++) {
+    if (ret == 0 && write(tap_fd, tx_queue[i].data, tx_queue[i].len) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("Error in driver_flush");
+      ret = -1;
+    }
+    buf_free(&tx_queue[i]);
+  }
+  tx_pending = 0;
+  return ret;
+}
+
+/**
+ * @brief 由net_poll调用，发送队列攒够一批或最早的帧等待超过延迟上限时发出
+ *
+ * @return int 成功为0，失败为-1
+ */
+int driver_tx_poll() {
+  if (driver_tx_due(tx_pending, tx_first_ms))
+    return driver_flush();
+  return 0;
+}
+
+/**
+ * @brief 获取接收方向可用于epoll等待的fd，由net_wait在空闲时阻塞其上
+ *
+ * @return int fd，设备中有帧时可读
+ */
+int driver_fd() { return tap_fd; }
+
+/**
+ * @brief 关闭网卡
+ *
+ */
+void driver_close() {
+  driver_flush();
+  close(tap_fd);
+  tap_fd = -1;
+}
+#endif
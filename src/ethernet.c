@@ -47,8 +47,7 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
   // 填入目的MAC地址
   memcpy(hdr->dst, mac, NET_MAC_LEN * sizeof(uint8_t));
   // 填入源MAC地址
-  uint8_t src_mac[] = NET_IF_MAC;
-  memcpy(hdr->src, src_mac, sizeof(src_mac));
+  memcpy(hdr->src, net_if_mac, NET_MAC_LEN * sizeof(uint8_t));
   // 填入目的协议
   hdr->protocol16 = swap16(protocol);
 
@@ -61,14 +60,21 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
  *
  */
 void ethernet_init() {
-  buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+  // 接收缓冲区在收到帧时才从缓冲池取slab，处理完立即归还
+  for (int i = 0; i < DRIVER_RX_BURST; i++)
+    buf_free(&rxbuf[i]);
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，收取并处理网卡中已到达的至多DRIVER_RX_BURST个帧
  *
+ * @return int 处理的帧数
  */
-void ethernet_poll() {
-  if (driver_recv(&rxbuf) > 0)
-    ethernet_in(&rxbuf);
+int ethernet_poll() {
+  int n = driver_recv_burst(rxbuf, DRIVER_RX_BURST);
+  for (int i = 0; i < n; i++) {
+    ethernet_in(&rxbuf[i]);
+    buf_free(&rxbuf[i]); // 上层需要保留的帧已自行拷贝或持有引用
+  }
+  return n > 0 ? n : 0;
 }
\ No newline at end of file
@@ -18,18 +18,20 @@ typedef struct {
  * @param src_ip 源ip地址
  */
 static void icmp_resp(buf_t *req_buf, uint8_t *src_ip) {
-  buf_init(&txbuf, req_buf->len);
+  if (buf_init(&txbuf, req_buf->len) < 0)
+    return;
   memcpy(txbuf.data, req_buf->data, req_buf->len);
 
   icmp_hdr_t *hdr = (icmp_hdr_t *)txbuf.data;
+  uint16_t type_code_old, type_code_new;
+  memcpy(&type_code_old, hdr, sizeof(uint16_t));
   hdr->type = ICMP_TYPE_ECHO_REPLY;
   hdr->code = 0;
+  memcpy(&type_code_new, hdr, sizeof(uint16_t));
 
-  hdr->checksum16 = 0;
-  // 校验和涵盖整个报文
-  uint16_t checksum16_new =
-      swap16(checksum16((uint16_t *)(txbuf.data), txbuf.len));
-  hdr->checksum16 = checksum16_new;
+  // 回显响应只改动了类型和代码，增量更新校验和，不必重新累加整个报文
+  hdr->checksum16 =
+      checksum_update16(hdr->checksum16, type_code_old, type_code_new);
 
   ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
@@ -57,6 +59,8 @@ void icmp_in(buf_t *buf, uint8_t *src_ip) {
   // 计算 seq id 对应的 interval
   if (hdr.type == ICMP_TYPE_ECHO_REPLY && hdr.code == 0) {
     icmp_echo_info *res = (icmp_echo_info *)map_get(&icmp_table, &(hdr.seq16));
+    if (res == NULL) // 未知或已超时的请求
+      return;
     struct timeval end;
     gettimeofday(&end, NULL);
     res->interval = ((end.tv_sec - res->start.tv_sec) * 1000 +
@@ -75,7 +79,8 @@ void icmp_in(buf_t *buf, uint8_t *src_ip) {
  * @param code icmp code，协议不可达或端口不可达
  */
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code) {
-  buf_init(&txbuf, 0);
+  if (buf_init(&txbuf, 0) < 0)
+    return;
   buf_add_header(&txbuf, sizeof(ip_hdr_t) + sizeof(uint8_t) * 8);
   memcpy(txbuf.data, recv_buf->data, sizeof(ip_hdr_t) + sizeof(uint8_t) * 8);
 
@@ -103,8 +108,8 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code) {
  * @return      该icmp请求编号
  */
 int icmp_send_echo_request(uint8_t *data, uint16_t len, uint8_t *dst_ip) {
-  buf_init(&txbuf, 0);
-  buf_add_header(&txbuf, len);
+  if (buf_init(&txbuf, len) < 0)
+    return -1;
   memcpy(txbuf.data, data, len);
 
   buf_add_header(&txbuf, sizeof(icmp_hdr_t));
@@ -139,7 +144,7 @@ int icmp_send_echo_request(uint8_t *data, uint16_t len, uint8_t *dst_ip) {
 // 这样的消息结构会更加优雅，不过为了方便起见就这样吧
 int icmp_wait_echo_reply(int target_seq) {
   icmp_echo_info *res = (icmp_echo_info *)map_get(&icmp_table, &(target_seq));
-  return res->interval;
+  return res ? res->interval : -1; // 超时的请求已被时间轮删除
 }
 
 /**
@@ -148,6 +153,6 @@ int icmp_wait_echo_reply(int target_seq) {
  */
 void icmp_init() {
   map_init(&icmp_table, sizeof(uint16_t), sizeof(icmp_echo_info), 0,
-           ICMP_TIMEOUT_TIME * 2, NULL);
+           ICMP_TIMEOUT_TIME * 2, NULL, NULL);
   net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
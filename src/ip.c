@@ -7,6 +7,7 @@
 #define MFU_SIZE 1500
 
 uint16_t id16 = 0; // xn: 当前ip报文所有分片发出去了之后，才能增加
+static ip_hdr_t ip_frag_hdr; // 最近发送的首部，同一报文的后续分片在其基础上修改
 
 typedef struct {
   uint16_t offset; // 该分片的 offset
@@ -35,15 +36,13 @@ int compare_do_pair(const void *a, const void *b) {
 
 map_t fragment_table; // <ip id, fragment_value> ，同一 ip 报文的分片 id 相同
 
-// foreach handler
-void fragtable_entry_free(void *key, void *value, time_t *timestamp) {
-  if (*timestamp + fragment_table.timeout < time(NULL)) {
-    // 超时，释放内存
-    fragment_value *fv = (fragment_value *)value;
-    for (int i = 0; i < fv->cnt; i++) {
-      free(fv->bufs[i].data);
-    }
+// 表项析构函数，表项被删除或超时时释放已收到的分片
+void fragtable_entry_free(void *value) {
+  fragment_value *fv = (fragment_value *)value;
+  for (int i = 0; i < fv->cnt; i++) {
+    free(fv->bufs[i].data);
   }
+  fv->cnt = 0;
 }
 
 void ip_fragment_in(uint8_t *data, uint16_t len, uint16_t flags_fragment16,
@@ -55,9 +54,6 @@ void ip_fragment_in(uint8_t *data, uint16_t len, uint16_t flags_fragment16,
     offset -= IP_MORE_FRAGMENT;
   offset *= 8;
 
-  // 首先删除整个 fragment table 超时的表项，防止内存泄漏
-  map_foreach(&fragment_table, fragtable_entry_free);
-
   // 查找驻留帧
   fragment_value *fv = map_get(&fragment_table, &id);
   if (!fv) { // 第一次收到该 id
@@ -67,7 +63,11 @@ void ip_fragment_in(uint8_t *data, uint16_t len, uint16_t flags_fragment16,
     new_fv.tot_size = 0;
     map_set(&fragment_table, &id, &new_fv);
     fv = map_get(&fragment_table, &id);
+    if (!fv)
+      return;
   }
+  if (fv->cnt == IP_MAX_FRAGMENT) // 分片过多，丢弃
+    return;
 
   if (!mf) {
     fv->is_over = true; // 表明已经收到了结束帧。注意此处不能直接整理然后 net_in
@@ -90,16 +90,18 @@ void ip_fragment_in(uint8_t *data, uint16_t len, uint16_t flags_fragment16,
     if (fv->bufs[fv->cnt - 1].offset + fv->bufs[fv->cnt - 1].len ==
         fv->tot_size) {
       // 全部接收完毕，传递给上层 UDP
-      buf_t new_buf;
-      buf_init(&new_buf, fv->tot_size);
+      buf_t new_buf = {0};
+      int ok = buf_init(&new_buf, fv->tot_size) == 0;
       uint8_t *p = new_buf.data;
       for (int i = 0; i < fv->cnt; i++) {
-        memcpy(p, fv->bufs[i].data, fv->bufs[i].len);
+        if (ok)
+          memcpy(p, fv->bufs[i].data, fv->bufs[i].len);
         p += fv->bufs[i].len;
-        free(fv->bufs[i].data);
       }
       map_delete(&fragment_table, &id);
-      net_in(&new_buf, protocol, src_ip);
+      if (ok)
+        net_in(&new_buf, protocol, src_ip);
+      buf_free(&new_buf);
     }
   }
 }
@@ -143,6 +145,14 @@ void ip_in(buf_t *buf, uint8_t *src_mac) {
   }
   buf_remove_header(buf, sizeof(ip_hdr_t));
 
+  // 未分片的报文直接把原buf递交上层，无需拷贝
+  uint16_t flags_fragment16 = swap16(ip_hdr.flags_fragment16);
+  if (!(flags_fragment16 & IP_MORE_FRAGMENT) &&
+      !(flags_fragment16 & (IP_MORE_FRAGMENT - 1))) {
+    net_in(buf, protocol, ip_hdr.src_ip);
+    return;
+  }
+
   // 传入
   ip_fragment_in(buf->data, buf->len, swap16(ip_hdr.flags_fragment16),
                  swap16(ip_hdr.id16), protocol, ip_hdr.src_ip);
@@ -163,13 +173,29 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id,
   buf_add_header(buf, sizeof(ip_hdr_t));
   ip_hdr_t *hdr = (ip_hdr_t *)buf->data;
 
+  offset /= 8;
+  if (offset) {
+    // 后续分片与第一个分片的首部只差总长度和分段字段，增量更新校验和
+    memcpy(hdr, &ip_frag_hdr, sizeof(ip_hdr_t));
+    uint16_t total_len16 = swap16((uint16_t)(buf->len));
+    uint16_t flags_fragment16 = swap16(mf | offset);
+    hdr->hdr_checksum16 = checksum_update16(hdr->hdr_checksum16,
+                                            hdr->total_len16, total_len16);
+    hdr->hdr_checksum16 = checksum_update16(
+        hdr->hdr_checksum16, hdr->flags_fragment16, flags_fragment16);
+    hdr->total_len16 = total_len16;
+    hdr->flags_fragment16 = flags_fragment16;
+    memcpy(&ip_frag_hdr, hdr, sizeof(ip_hdr_t));
+    arp_out(buf, ip);
+    return;
+  }
+
   hdr->hdr_len = (sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE);
   hdr->version = IP_VERSION_4;
   hdr->tos = 0;
   hdr->total_len16 = swap16((uint16_t)(buf->len));
   hdr->id16 = swap16((uint16_t)(id16));
 
-  offset /= 8;
   hdr->flags_fragment16 = swap16(mf | offset);
   hdr->ttl = IP_DEFALUT_TTL;
   hdr->protocol = protocol;
@@ -178,6 +204,7 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id,
 
   hdr->hdr_checksum16 = 0;
   hdr->hdr_checksum16 = swap16(checksum16((uint16_t *)hdr, sizeof(ip_hdr_t)));
+  memcpy(&ip_frag_hdr, hdr, sizeof(ip_hdr_t));
 
   arp_out(buf, ip);
 }
@@ -199,28 +226,31 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
     return;
   }
 
-  // 分片处理
+  // 分片处理，各分片复用同一个池化buf
+  buf_t ip_buf = {0};
   int n = buf->len / slice;
   for (int i = 0; i <= n - 1; i++) {
-    buf_t ip_buf;
-    buf_init(&ip_buf, slice * sizeof(uint8_t));
+    if (buf_init(&ip_buf, slice * sizeof(uint8_t)) < 0)
+      goto out;
     memcpy(ip_buf.data, buf->data + i * slice, slice * sizeof(uint8_t));
     if (__builtin_expect((i == n - 1 && n * slice == buf->len),
                          0)) { // buf->len被slice整除时标记MF
       ip_fragment_out(&ip_buf, ip, protocol, i, i * slice, 0);
-      return;
+      goto out;
     }
     ip_fragment_out(&ip_buf, ip, protocol, i, i * slice, IP_MORE_FRAGMENT);
   }
 
   // 处理buf->len不被slice整除时的最后剩的一点尾巴
-  buf_t ip_buf;
-  buf_init(&ip_buf, (buf->len - n * slice) * sizeof(uint8_t));
+  if (buf_init(&ip_buf, (buf->len - n * slice) * sizeof(uint8_t)) < 0)
+    goto out;
   memcpy(ip_buf.data, buf->data + n * slice,
          (buf->len - n * slice) * sizeof(uint8_t));
   ip_fragment_out(&ip_buf, ip, protocol, n, n * slice, 0);
 
   id16++; // 当前ip报文所有分片发送完毕
+out:
+  buf_free(&ip_buf);
 }
 
 /**
@@ -229,6 +259,6 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
  */
 void ip_init() {
   map_init(&fragment_table, sizeof(uint16_t), sizeof(fragment_value), 0,
-           IP_FRAGMENT_TIMEOUT_SEC, NULL);
+           IP_FRAGMENT_TIMEOUT_SEC, NULL, fragtable_entry_free);
   net_add_protocol(NET_PROTOCOL_IP, ip_in);
 }
\ No newline at end of file
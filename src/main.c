@@ -25,7 +25,7 @@ void handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
 void udp_listen() {
   udp_open(60000, handler); // 注册端口的udp监听回调
   while (1) {
-    net_poll(); // 一次主循环
+    net_wait(); // 一次主循环，空闲时阻塞等待
   }
 }
 #endif
@@ -39,7 +39,7 @@ void echo_handler(uint8_t *data, size_t len, uint8_t *src_ip,
     putchar('\n');
   fflush(stdout);
 
-  tcp_send(data, len, 60000, src_ip, 60000); //发送udp包
+  tcp_send(data, len, 60000, src_ip, src_port); // 回显给发来数据的连接
 }
 
 void tcp_server() {
@@ -47,11 +47,11 @@ void tcp_server() {
 
   tcp_open(60000, echo_handler, 1); // 启动 TCP 监听
   while (1) {
-    net_poll(); // 一次主循环
+    net_wait(); // 一次主循环，空闲时阻塞等待
   }
 
   uint8_t dst_ip[NET_IP_LEN] = {10, 250, 196, 1};
-  tcp_close(60000, dst_ip); // 关闭 TCP 连接，事实上是unreachable
+  tcp_close(60000, dst_ip, 60000); // 关闭 TCP 连接，事实上是unreachable
 }
 
 #ifdef HTTP
@@ -80,11 +80,11 @@ void http_server() {
 
   tcp_open(62000, http_handler, 1); // 启动 TCP 监听
   while (1) {
-    net_poll(); // 一次主循环
+    net_wait(); // 一次主循环，空闲时阻塞等待
   }
 
   uint8_t dst_ip[NET_IP_LEN] = {10, 250, 196, 1};
-  tcp_close(62000, dst_ip); // 关闭 TCP 连接，事实上是unreachable
+  tcp_close(62000, dst_ip, 62000); // 关闭 TCP 连接，事实上是unreachable
 }
 #endif
 
@@ -99,9 +99,7 @@ void say_hi_handler(uint8_t *data, size_t len, uint8_t *src_ip,
   fflush(stdout);
 
   char *str = "hi";
-  for (int i = 0; i < strlen(str); i++) {
-    queue_push(&outstream, (uint8_t)(str[i]));
-  }
+  tcp_send((uint8_t *)str, strlen(str), 60000, src_ip, src_port);
 }
 
 void tcp_client() {
@@ -109,18 +107,17 @@ void tcp_client() {
   uint8_t dst_ip[NET_IP_LEN] = {10, 250, 196, 1};
 
   tcp_open(60000, say_hi_handler, 0); // 注册 TCP 处理程序
-  tcp_connect(60000, dst_ip);         // 创建 TCP 连接（发送 SYN ）
+  tcp_connect(60000, dst_ip, 60000);  // 创建 TCP 连接（发送 SYN ）
 
   while (handle_times < 5) { // 发送五次数据
-    net_poll();
+    net_wait();
   }
 
   printf("close connection.\n");
-  sleep(1); // 等待一段时间以保证 fully acked （偷懒实现）
-  tcp_close(60000, dst_ip); // 关闭 TCP 连接 （发送 FIN ）
+  tcp_close(60000, dst_ip, 60000); // 关闭 TCP 连接，发完缓冲区中的数据后发送 FIN
 
-  while (!(tcp_is_closed())) { // 等待 server 的 FIN-ACK
-    net_poll();
+  while (!(tcp_is_closed(60000, dst_ip, 60000))) { // 等待 server 的 FIN-ACK
+    net_wait();
   }
   printf("client exit.\n"); // 成功退出
 }
@@ -153,7 +150,7 @@ void ping() {
 
     int interval = 0;
     while (time(NULL) < last_request_time + ICMP_TIMEOUT_TIME) {
-      net_poll(); // 一次主循环
+      net_wait(); // 一次主循环，空闲时阻塞等待
       interval = icmp_wait_echo_reply(waiting_req_seq);
       if (interval != -1)
         break;
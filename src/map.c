@@ -1,22 +1,26 @@
 #include "map.h"
+#include "utils.h"
 #include <string.h>
 
+static int map_resize(map_t *map, size_t capacity);
+
 /**
  * @brief 初始化map
  *
  * @param map 要初始化的map
  * @param key_len 键的长度
  * @param value_len 值的长度
- * @param max_size 最大容量，为0则根据MAP_MAX_LEN自动设置
+ * @param max_size 最大容量，为0则使用MAP_MAX_SIZE
  * @param timeout 超时秒数，为0则永不超时
  * @param value_constuctor
  * 形如memcpy的构造函数，用于拷贝值到容器中，为NULL则使用memcpy
+ * @param value_destructor 值的析构函数，为NULL则不做处理
  */
 void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size,
-              time_t timeout, map_constuctor_t value_constuctor) {
-  if (max_size == 0 ||
-      max_size * (key_len + value_len + sizeof(time_t)) > MAP_MAX_LEN)
-    max_size = MAP_MAX_LEN / (key_len + value_len + sizeof(time_t));
+              time_t timeout, map_constuctor_t value_constuctor,
+              map_destructor_t value_destructor) {
+  if (max_size == 0 || max_size > MAP_MAX_SIZE)
+    max_size = MAP_MAX_SIZE;
   if (value_constuctor == NULL)
     value_constuctor = (map_constuctor_t)memcpy;
 
@@ -26,6 +30,10 @@ void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size,
   map->max_size = max_size;
   map->timeout = timeout;
   map->value_constuctor = value_constuctor;
+  map->value_destructor = value_destructor;
+  map->free_pos = UINT32_MAX;
+  // 分配失败时容量为0，之后的map_set会再次尝试扩容
+  map_resize(map, max_size < MAP_INIT_SIZE ? max_size : MAP_INIT_SIZE);
 }
 
 /**
@@ -44,7 +52,7 @@ size_t map_size(map_t *map) { return map->size; }
  * @return void* 键值对指针
  */
 void *map_entry_get(map_t *map, size_t pos) {
-  if (pos >= map->max_size)
+  if (pos >= map->capacity)
     return NULL;
   return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
 }
@@ -61,7 +69,174 @@ int map_entry_valid(map_t *map, const void *entry) {
       *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
   // xn: 未设置时间戳 或者 超时
   return entry_time &&
-         (!map->timeout || entry_time + map->timeout >= time(NULL));
+         (!map->timeout || entry_time + map->timeout >= net_clock());
+}
+
+/**
+ * @brief 内部函数，获取键值对的时间戳指针
+ *
+ * @param map 所属的map
+ * @param entry 键值对指针
+ * @return time_t* 时间戳指针，时间戳为0表示该位置空闲
+ */
+static time_t *map_entry_timestamp(map_t *map, const void *entry) {
+  return (time_t *)((uint8_t *)entry + map->key_len + map->value_len);
+}
+
+/**
+ * @brief 内部函数，计算键的哈希值（FNV-1a）对应的索引槽
+ *
+ * @param map 所属的map
+ * @param key 键指针
+ * @return size_t 线性探测的起始槽
+ */
+static size_t map_hash(map_t *map, const void *key) {
+  const uint8_t *p = key;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < map->key_len; i++) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash % map->index_size;
+}
+
+/**
+ * @brief 内部函数，在哈希索引中探测键
+ * 索引槽数是容量的两倍，所以探测序列上一定有空槽
+ *
+ * @param map 要探测的map
+ * @param key 键指针
+ * @return size_t 键所在的槽，不存在则为探测结束处的空槽
+ */
+static size_t map_index_probe(map_t *map, const void *key) {
+  size_t slot = map_hash(map, key);
+  for (;;) {
+    uint32_t pos = map->index[slot];
+    if (pos == 0 || !memcmp(key, map_entry_get(map, pos - 1), map->key_len))
+      return slot;
+    if (++slot == map->index_size)
+      slot = 0;
+  }
+}
+
+/**
+ * @brief 内部函数，删除索引槽对应的键值对，并把探测序列上后续的槽前移，不留墓碑
+ *
+ * @param map 要操作的map
+ * @param slot 要删除的索引槽
+ */
+static void map_remove_slot(map_t *map, size_t slot) {
+  uint32_t pos = map->index[slot] - 1;
+  uint8_t *entry = map_entry_get(map, pos);
+  if (map->timers)
+    timer_del(&map->timers[pos]);
+  if (map->value_destructor)
+    map->value_destructor(entry + map->key_len);
+  *map_entry_timestamp(map, entry) = 0;
+  memcpy(entry, &map->free_pos, sizeof(uint32_t)); // 放回空闲链表
+  map->free_pos = pos;
+  map->size--;
+
+  size_t hole = slot, next = slot;
+  for (;;) {
+    if (++next == map->index_size)
+      next = 0;
+    if (map->index[next] == 0)
+      break;
+    // 起始槽不在 (hole, next] 内的索引可以前移到 hole
+    size_t home = map_hash(map, map_entry_get(map, map->index[next] - 1));
+    if (hole <= next ? (home <= hole || home > next)
+                     : (home <= hole && home > next)) {
+      map->index[hole] = map->index[next];
+      hole = next;
+    }
+  }
+  map->index[hole] = 0;
+}
+
+/**
+ * @brief 内部函数，键值对的超时定时器回调，到期即删除该键值对并释放其值
+ *
+ * @param timer 到期的定时器
+ */
+static void map_entry_expire(net_timer_t *timer) {
+  map_t *map = timer->arg;
+  uint8_t *entry = map_entry_get(map, timer - map->timers);
+  if (*map_entry_timestamp(map, entry))
+    map_remove_slot(map, map_index_probe(map, entry));
+}
+
+/**
+ * @brief 内部函数，把map的容量调整为capacity，原有键值对的位置不变，
+ * 定时器原样迁移，哈希索引按新的槽数重建
+ *
+ * @param map 要调整的map
+ * @param capacity 新容量，不小于map->used
+ * @return int 成功为0，内存不足为-1，此时map保持不变
+ */
+static int map_resize(map_t *map, size_t capacity) {
+  size_t entry_len = map->key_len + map->value_len + sizeof(time_t);
+  // 每个键值对对应两个索引槽，使索引的装载因子不超过1/2
+  uint8_t *data = realloc(map->data, capacity * entry_len);
+  if (data == NULL)
+    return -1;
+  map->data = data;
+  uint32_t *index = calloc(2 * capacity, sizeof(uint32_t));
+  net_timer_t *timers =
+      map->timeout ? calloc(capacity, sizeof(net_timer_t)) : NULL;
+  if (index == NULL || (map->timeout && timers == NULL)) {
+    free(index);
+    free(timers);
+    return -1;
+  }
+
+  if (map->timers) {
+    for (size_t i = 0; i < map->used; i++)
+      timer_move(&timers[i], &map->timers[i]);
+    free(map->timers);
+  }
+  map->timers = timers;
+  free(map->index);
+  map->index = index;
+  map->index_size = 2 * capacity;
+  map->capacity = capacity;
+  for (size_t i = 0; i < map->used; i++) {
+    uint8_t *entry = map_entry_get(map, i);
+    if (*map_entry_timestamp(map, entry))
+      map->index[map_index_probe(map, entry)] = i + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 内部函数，取一个空闲的键值对位置，没有空闲位置时先回收过期的键值对，
+ * 仍然没有则扩容
+ *
+ * @param map 要操作的map
+ * @return uint32_t 空闲位置，map已满为UINT32_MAX
+ */
+static uint32_t map_entry_alloc(map_t *map) {
+  if (map->free_pos == UINT32_MAX && map->used == map->capacity) {
+    for (size_t i = 0; i < map->used; i++) {
+      uint8_t *entry = map_entry_get(map, i);
+      if (*map_entry_timestamp(map, entry) && !map_entry_valid(map, entry))
+        map_remove_slot(map, map_index_probe(map, entry));
+    }
+  }
+
+  uint32_t pos = map->free_pos;
+  if (pos != UINT32_MAX) {
+    memcpy(&map->free_pos, map_entry_get(map, pos), sizeof(uint32_t));
+    return pos;
+  }
+  if (map->used == map->capacity) {
+    size_t capacity = 2 * map->capacity;
+    if (capacity > map->max_size)
+      capacity = map->max_size;
+    if (capacity == map->capacity || map_resize(map, capacity))
+      return UINT32_MAX;
+  }
+  return map->used++;
 }
 
 /**
@@ -69,17 +244,17 @@ int map_entry_valid(map_t *map, const void *entry) {
  *
  * @param map 要获取的map
  * @param key 键指针
- * @return void* 值指针，找不到为NULL
+ * @return void* 值指针，找不到为NULL。之后调用 map_set 可能扩容搬移数据，
+ * 指针随之失效
  */
 void *map_get(map_t *map, const void *key) {
-  if (key == NULL)
+  if (key == NULL || map->capacity == 0)
     return NULL;
-  for (size_t i = 0; i < map->max_size; i++) {
-    uint8_t *entry = map_entry_get(map, i);
-    if (map_entry_valid(map, entry) && !memcmp(key, entry, map->key_len))
-      return entry + map->key_len;
-  }
-  return NULL;
+  uint32_t pos = map->index[map_index_probe(map, key)];
+  if (pos == 0)
+    return NULL;
+  uint8_t *entry = map_entry_get(map, pos - 1);
+  return map_entry_valid(map, entry) ? entry + map->key_len : NULL;
 }
 
 /**
@@ -91,28 +266,40 @@ void *map_get(map_t *map, const void *key) {
  * @return int 成功为0，失败为-1
  */
 int map_set(map_t *map, const void *key, const void *value) {
-  uint8_t *old_value = map_get(map, key);
-  if (old_value) // xn: update
+  if (key == NULL)
+    return -1;
+  if (map->capacity == 0 && // map_init时分配失败，重试
+      map_resize(map, map->max_size < MAP_INIT_SIZE ? map->max_size
+                                                    : MAP_INIT_SIZE))
+    return -1;
+  size_t slot = map_index_probe(map, key);
+  if (map->index[slot]) // xn: update，已过期的键值对也原地复用
   {
+    uint32_t pos = map->index[slot] - 1;
+    uint8_t *old_value = (uint8_t *)map_entry_get(map, pos) + map->key_len;
+    if (map->value_destructor)
+      map->value_destructor(old_value);
     map->value_constuctor(old_value, value, map->value_len);
-    *(time_t *)(old_value + map->value_len) = time(NULL);
+    *(time_t *)(old_value + map->value_len) = net_clock();
+    if (map->timers)
+      timer_add(&map->timers[pos], map->timeout * 1000, map_entry_expire, map);
     return 0;
   }
-  if (map->size == map->max_size)
-    return -1;
-  for (size_t i = 0; i < map->max_size; i++) // insert
-  {
-    uint8_t *entry = map_entry_get(map, i);
-    if (!map_entry_valid(map, entry)) {
-      memcpy(entry, key, map->key_len);
-      map->value_constuctor(entry + map->key_len, value, map->value_len);
-      *(time_t *)(entry + map->key_len + map->value_len) = time(NULL);
-      map->size++;
-      return 0;
-    }
-  }
 
-  return -1;
+  // insert
+  uint32_t pos = map_entry_alloc(map);
+  if (pos == UINT32_MAX)
+    return -1;
+  slot = map_index_probe(map, key); // 回收过期键值对可能移动了索引
+  uint8_t *entry = map_entry_get(map, pos);
+  memcpy(entry, key, map->key_len);
+  map->value_constuctor(entry + map->key_len, value, map->value_len);
+  *map_entry_timestamp(map, entry) = net_clock();
+  map->index[slot] = pos + 1;
+  map->size++;
+  if (map->timers)
+    timer_add(&map->timers[pos], map->timeout * 1000, map_entry_expire, map);
+  return 0;
 }
 
 /**
@@ -122,22 +309,22 @@ int map_set(map_t *map, const void *key, const void *value) {
  * @param key 键指针
  */
 void map_delete(map_t *map, const void *key) {
-  uint8_t *value = map_get(map, key);
-  if (value) {
-    *(time_t *)(value + map->value_len) = 0; // xn: 删除只需标记为invalid即可
-    map->size--;
-  }
+  if (key == NULL || map->capacity == 0)
+    return;
+  size_t slot = map_index_probe(map, key);
+  if (map->index[slot])
+    map_remove_slot(map, slot);
 }
 
 /**
- * @brief 遍历map
+ * @brief 遍历map，按键值对的存放位置顺序
  *
  * @param map 要遍历的map
  * @param handler
  * 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针）
  */
 void map_foreach(map_t *map, map_entry_handler_t handler) {
-  for (size_t i = 0; i < map->max_size; i++) {
+  for (size_t i = 0; i < map->used; i++) {
     uint8_t *entry = map_entry_get(map, i);
     if (map_entry_valid(map, entry))
       handler(entry, entry + map->key_len,
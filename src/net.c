@@ -5,13 +5,38 @@
 #include "icmp.h"
 #include "ip.h"
 #include "tcp.h"
+#include "timer.h"
 #include "udp.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 /**
- * @brief 协议表 <协议号,处理程序>的容器
+ * @brief 协议表，按协议号直接索引处理程序。
+ * IP协议号只有8位，直接作为下标；以太网类型号都不小于0x0600，
+ * 与IP协议号不会冲突，只有少数几种，通过net_eth_index映射到紧凑的下标
  *
  */
-map_t net_table;
+static net_handler_t net_ip_table[UINT8_MAX + 1];
+static net_handler_t net_eth_table[NET_ETH_PROTOCOL_NUM];
+
+/**
+ * @brief 内部函数，获取以太网类型号在协议表中的下标
+ *
+ * @param protocol 以太网类型号
+ * @return int 下标，不支持的类型为-1
+ */
+static inline int net_eth_index(uint16_t protocol) {
+  switch (protocol) {
+  case NET_PROTOCOL_IP:
+    return 0;
+  case NET_PROTOCOL_ARP:
+    return 1;
+  default:
+    return -1;
+  }
+}
 
 /**
  * @brief 网卡MAC地址
@@ -33,16 +58,37 @@ uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
 // xn: 只是有一点，关于 rxbuf 和 txbuf 设计为 global variable
 // 的意图？完全可以设计为局部变量。
 // 这样做我想大概是为了分层更加清晰，体现出协议栈同 driver 层的接口
-buf_t rxbuf, txbuf; // 一个buf足够单线程使用
+buf_t rxbuf[DRIVER_RX_BURST], txbuf; // 单线程使用，接收按批进行
+
+/**
+ * @brief 事件循环的状态。空闲后先忙轮询一个窗口，仍无事可做才阻塞在网卡上；
+ * 窗口内等到了帧说明流量密集，窗口加倍，白等后阻塞说明流量稀疏，窗口减半
+ *
+ */
+static int net_epfd = -1;          // 监听网卡的epoll，网卡没有可等待的fd时为-1
+static uint64_t net_idle_since;    // 开始空闲的时间（微秒），0为不空闲
+static uint64_t net_busy_us = NET_BUSY_POLL_MIN_US; // 当前的忙轮询窗口
 
 /**
  * @brief 初始化协议栈
  *
  */
 int net_init() {
-  map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
+  memset(net_ip_table, 0, sizeof(net_ip_table));
+  memset(net_eth_table, 0, sizeof(net_eth_table));
   if (driver_open() == -1)
     return -1;
+#ifdef __linux__
+  int fd = driver_fd();
+  if (fd >= 0 && net_epfd < 0) {
+    struct epoll_event ev = {.events = EPOLLIN};
+    net_epfd = epoll_create1(0);
+    if (net_epfd >= 0 && epoll_ctl(net_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(net_epfd);
+      net_epfd = -1;
+    }
+  }
+#endif
 
   ethernet_init();
   arp_init();
@@ -62,7 +108,17 @@ int net_init() {
 // xn: 由于各个协议的 init 函数中
 // xn: 一个非常漂亮的委托实现
 void net_add_protocol(uint16_t protocol, net_handler_t handler) {
-  map_set(&net_table, &protocol, &handler);
+  if (protocol <= UINT8_MAX) {
+    net_ip_table[protocol] = handler;
+    return;
+  }
+  int index = net_eth_index(protocol);
+  if (index < 0) {
+    fprintf(stderr, "Error in net_add_protocol: unsupported protocol 0x%04x\n",
+            protocol);
+    return;
+  }
+  net_eth_table[index] = handler;
 }
 
 /**
@@ -74,9 +130,15 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler) {
  * @return int 成功为0，失败为-1
  */
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src) {
-  net_handler_t *handler = map_get(&net_table, &protocol);
+  net_handler_t handler;
+  if (protocol <= UINT8_MAX) {
+    handler = net_ip_table[protocol];
+  } else {
+    int index = net_eth_index(protocol);
+    handler = index < 0 ? NULL : net_eth_table[index];
+  }
   if (handler) {
-    (*handler)(buf, src);
+    handler(buf, src);
     return 0;
   }
   return -1;
@@ -85,10 +147,52 @@ int net_in(buf_t *buf, uint16_t protocol, uint8_t *src) {
 /**
  * @brief 一次协议栈轮询
  *
+ * @return int 本轮处理的帧数与到期的定时器数之和，为0表示无事可做
  */
-void net_poll() {
-  tcp_tick();
+int net_poll() {
+  int work;
+  net_clock_update();
+  work = timer_run(net_clock_ms()); // 处理所有到期的定时器，如表项超时与超时重传
 #ifdef ETHERNET
-  ethernet_poll();
+  work += ethernet_poll();
+#endif
+  driver_tx_poll(); // 发送队列攒够一批或等待超过延迟上限时一次发出
+  return work;
+}
+
+/**
+ * @brief 一次事件驱动的主循环，代替忙等的net_poll。
+ * 有事可做时与net_poll相同；空闲超过忙轮询窗口后阻塞在网卡的fd上，
+ * 直到有帧到达、下一个定时器到期或超过NET_WAIT_MAX_MS
+ *
+ */
+void net_wait() {
+  if (net_poll() > 0) {
+    if (net_idle_since) // 忙轮询期间等到了帧
+      net_busy_us = net_busy_us * 2 < NET_BUSY_POLL_MAX_US
+                        ? net_busy_us * 2
+                        : NET_BUSY_POLL_MAX_US;
+    net_idle_since = 0;
+    return;
+  }
+  if (net_epfd < 0)
+    return; // 网卡没有可等待的fd，只能忙轮询
+  if (!net_idle_since) {
+    net_idle_since = net_clock_us();
+    return;
+  }
+  if (net_clock_us() - net_idle_since < net_busy_us)
+    return;
+
+#ifdef __linux__
+  driver_flush(); // 阻塞前发出暂存的帧
+  int64_t timeout = timer_next(net_clock_ms());
+  if (timeout < 0 || timeout > NET_WAIT_MAX_MS)
+    timeout = NET_WAIT_MAX_MS;
+  struct epoll_event ev;
+  epoll_wait(net_epfd, &ev, 1, (int)timeout);
 #endif
+  if (net_busy_us / 2 >= NET_BUSY_POLL_MIN_US)
+    net_busy_us /= 2;
+  net_idle_since = 0;
 }
\ No newline at end of file
@@ -1,40 +1,57 @@
 #include "tcp.h"
-#include "icmp.h"
 #include "ip.h"
-#include <assert.h>
-
-map_t tcp_table; // 记录 <port, handler>
-queue outstream; // 与上层 APP 交互的数据流，待发送
-/* 状态转换相关 */
-int is_server = 0;   // 主机是 server 吗？
-int syn_receive = 0; // 标识是否已经收到 syn 信号
-int syn_send = 0;    // 标识是否已经发送 syn 信号
-int fin_receive = 0; // 标识是否已经收到 fin 信号
-int fin_send = 0;    // 标识是否已经发送 fin 信号
-int is_end = 0;      // 当前连接是否结束
-int should_ack = 0;  // 标记己方是否需要 ack
-/* TCP 传输字段相关 */
-int window_size = 4;   // 发送窗口
-uint32_t seq = 0;      // 当前发送的序列号
-uint32_t ackno = 0;    // 当前要发的 ACK
-uint32_t peer_seq = 0; // 对方发来的序列号
-uint32_t peer_ack = 0; // 对方发来的 ACK
-/* 超时重传相关 */
-int retrans_time_cnt_on = 0; // 记录是否进行超时统计
-time_t start = 0;            // 当前帧发送出去的时间
-buf_t restrans_sent_data;    // 需要重传的数据帧
-
-/**
- * @brief 重置 tcp 连接
- */
-void tcp_rst() {
-  window_size = 4;
-  syn_receive = 0;
-  syn_send = 0;
-  fin_receive = 0;
-  fin_send = 0;
-  should_ack = false;
-}
+#include "tcp_cc.h"
+#include "tcp_opt.h"
+
+// xn: 每个连接的全部状态都在各自的传输控制块（TCB）中，TCB 单独分配，
+// 连接表中只存放指针，这样连接表扩容搬移时 TCB 的地址不变，内嵌的定时器依然有效。
+// 收到报文时按四元组在连接表中查找 TCB，找不到时再查端口表，
+// 监听中的端口收到 SYN 就新建一个 TCB，其余情况回复 RST。
+// 状态机按 RFC 793 的 SEGMENT ARRIVES 一节实现。
+// 发送方在对方通告的窗口内连续发出多个报文段，接收窗口由接收缓冲区的大小决定，
+// 二者都可以超过 64KB，由 SYN 中协商的窗口扩大因子（RFC 7323）换算。
+// 发出的每个报文段都记入重传队列，数据本身留在发送缓冲区中，重传时再从中取出；
+// 超时重传时间按 RFC 6298 由 RTT 测量值计算，精确到毫秒，超时后指数退避。
+// 第三个重复确认触发快速重传，之后按 NewReno（RFC 6582）逐个重传部分确认后
+// 的空缺，孤立的丢包约一个 RTT 即可修复，不必等到超时。
+// 发送量同时受对方窗口和拥塞窗口限制，拥塞窗口由可替换的拥塞控制模块
+// （tcp_cc.h）维护，模块给出发送速率时再按速率间隔发送。
+// 接收方向乱序到达的数据引用缓冲池中的 slab 暂存在乱序队列中，不拷贝，
+// 空缺补上后按序交给应用，对方不必重传空缺之后的数据。
+// 双方都允许 SACK 时，确认中用 SACK 块告诉对方乱序队列中有哪些数据；
+// 发送方据此在重传队列中标记已收到的报文段，丢包恢复中只按记分板重传空缺，
+// 不再按部分确认推测（RFC 6675）
+// 选项的解析、填写和协商在 tcp_opt.c 中，协商了时间戳时每个报文段都带上它，
+// 用于 PAWS 和重传后的 RTT 测量
+
+/**
+ * @brief 连接表，<tcp_key_t, tcp_tcb_t *>的容器
+ *
+ */
+map_t tcp_table;
+
+/**
+ * @brief 端口表，<port, tcp_port_t>的容器，记录已打开端口的处理程序
+ *
+ */
+map_t tcp_ports;
+
+typedef struct tcp_port {
+  tcp_handler_t handler; // 该端口上所有连接共用的回调函数
+  int server;            // 是否监听，监听的端口收到 SYN 时新建连接
+} tcp_port_t;
+
+/**
+ * @brief 所有连接的重传计数
+ *
+ */
+tcp_stats_t tcp_stats;
+
+static uint32_t tcp_iss_offset; // 让同一时刻建立的连接初始序号也各不相同
+
+static void tcp_timer_expire(net_timer_t *timer);
+static void tcp_output(tcp_tcb_t *tcb);
+static void tcp_pace_expire(net_timer_t *timer);
 
 /**
  * @brief tcp伪校验和计算
@@ -45,123 +62,1171 @@ void tcp_rst() {
  * @return uint16_t 伪校验和
  */
 static uint16_t tcp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
-  uint16_t length = buf->len;
-
-  buf_add_header(buf, sizeof(tcp_peso_hdr_t));
-  tcp_peso_hdr_t ip_hdr;
-  memcpy(&ip_hdr, buf->data, sizeof(tcp_peso_hdr_t));
-
-  tcp_peso_hdr_t *peso_hdr = (tcp_peso_hdr_t *)buf->data;
-  memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN * sizeof(uint8_t));
-  memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN * sizeof(uint8_t));
-  peso_hdr->placeholder = 0;
-  peso_hdr->protocol = NET_PROTOCOL_TCP;
-  peso_hdr->total_len16 = swap16(length);
-
-  uint16_t res = checksum16((uint16_t *)(buf->data), buf->len);
-  memcpy(buf->data, &ip_hdr, sizeof(tcp_peso_hdr_t));
-  buf_remove_header(buf, sizeof(tcp_peso_hdr_t));
-  return res;
+  // 伪首部直接按字段累加，不在buf的头部预留区中构造
+  uint32_t sum =
+      checksum_pseudo(src_ip, dst_ip, NET_PROTOCOL_TCP, buf->len, 0);
+  return swap16(checksum_fold(checksum_partial(buf->data, buf->len, sum)));
 }
 
 /**
- * @brief 发送 tcp 报文
+ * @brief 内部函数，加上 tcp 首部并发送，数据部分的校验和已经算好
  *
- * @param data  要发送的数据
- * @param len   数据长度
+ * @param buf 要发送的数据
  * @param src_port 源端口
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口
+ * @param seq 序号
+ * @param ack 确认号，flags 中没有 FLAG_ACK 时忽略
+ * @param flags 标志位
+ * @param win 通告窗口
+ * @param opt 选项，长度须为4的倍数
+ * @param opt_len 选项长度
+ * @param sum 数据部分的校验和部分和
  */
-void tcp_out(buf_t *buf, int len, uint16_t src_port, uint8_t *dst_ip,
-             uint16_t dst_port, int syn, int fin, int ack) {
-  buf_add_header(buf, sizeof(tcp_hdr_t));
+static void tcp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip,
+                    uint16_t dst_port, uint32_t seq, uint32_t ack,
+                    uint8_t flags, uint16_t win, const uint8_t *opt,
+                    uint8_t opt_len, uint32_t sum) {
+  buf_add_header(buf, sizeof(tcp_hdr_t) + opt_len);
   tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
-  hdr->flags = 0;
-  hdr->doff = ((TCP_HEADER_LEN / 4) << 4);
+  memcpy(hdr + 1, opt, opt_len);
   hdr->src_port16 = swap16(src_port);
   hdr->dst_port16 = swap16(dst_port);
-  hdr->win = swap16(window_size);
-  // 填写seqno
   hdr->seqno = swap32(seq);
+  hdr->ackno = (flags & FLAG_ACK) ? swap32(ack) : 0;
+  hdr->doff = (((TCP_HEADER_LEN + opt_len) / 4) << 4);
+  hdr->flags = flags;
+  hdr->win = swap16(win);
+  hdr->uptr = 0;
+
+  // 校验和，数据部分已算好，只需再加上首部和伪首部
+  hdr->checksum16 = 0;
+  sum = checksum_partial(hdr, sizeof(tcp_hdr_t) + opt_len, sum);
+  sum = checksum_pseudo(net_if_ip, dst_ip, NET_PROTOCOL_TCP, buf->len, sum);
+  hdr->checksum16 = checksum_fold(sum);
+
+  ip_out(buf, dst_ip, NET_PROTOCOL_TCP);
+}
+
+/**
+ * @brief 内部函数，发送不属于任何连接的 RST 报文
+ *
+ * @param dst_ip 目的ip地址
+ * @param src_port 源端口
+ * @param dst_port 目的端口
+ * @param seq 序号
+ * @param ack 确认号
+ * @param flags FLAG_RST，可能带有 FLAG_ACK
+ */
+static void tcp_send_rst(uint8_t *dst_ip, uint16_t src_port, uint16_t dst_port,
+                         uint32_t seq, uint32_t ack, uint8_t flags) {
+  buf_t buf = {0};
+  if (buf_init(&buf, 0) < 0)
+    return;
+  tcp_out(&buf, src_port, dst_ip, dst_port, seq, ack, flags, 0, NULL, 0, 0);
+  buf_free(&buf);
+}
 
-  seq += len;
-  // 还没开始链接，发送
-  if (syn) {
-    seq++;
-    hdr->flags = (hdr->flags | FLAG_SYN);
+/**
+ * @brief 内部函数，填写连接的四元组
+ *
+ * @param key 出口参数
+ * @param local_port 本地端口
+ * @param remote_ip 对方ip地址
+ * @param remote_port 对方端口
+ */
+static void tcp_key_init(tcp_key_t *key, uint16_t local_port,
+                         uint8_t *remote_ip, uint16_t remote_port) {
+  memcpy(key->local_ip, net_if_ip, NET_IP_LEN);
+  key->local_port = local_port;
+  memcpy(key->remote_ip, remote_ip, NET_IP_LEN);
+  key->remote_port = remote_port;
+}
+
+/**
+ * @brief 内部函数，按四元组查找连接
+ *
+ * @param local_port 本地端口
+ * @param remote_ip 对方ip地址
+ * @param remote_port 对方端口
+ * @return tcp_tcb_t* 连接，不存在为NULL
+ */
+static tcp_tcb_t *tcp_lookup(uint16_t local_port, uint8_t *remote_ip,
+                             uint16_t remote_port) {
+  tcp_key_t key;
+  tcp_key_init(&key, local_port, remote_ip, remote_port);
+  tcp_tcb_t **tcb = map_get(&tcp_table, &key);
+  return tcb ? *tcb : NULL;
+}
+
+/**
+ * @brief 内部函数，新建一个连接并加入连接表
+ *
+ * @param key 四元组
+ * @param handler 回调函数
+ * @param state 初始状态
+ * @return tcp_tcb_t* 新连接，失败为NULL
+ */
+static tcp_tcb_t *tcp_tcb_new(tcp_key_t *key, tcp_handler_t handler,
+                              tcp_state_t state) {
+  tcp_tcb_t *tcb = calloc(1, sizeof(tcp_tcb_t));
+  if (!tcb)
+    return NULL;
+  if (map_set(&tcp_table, key, &tcb) < 0) {
+    free(tcb);
+    return NULL;
   }
-  // 对方链接关闭
-  if (fin) {
-    seq++;
-    hdr->flags = (hdr->flags | FLAG_FIN);
+  tcb->key = *key;
+  tcb->handler = handler;
+  tcb->state = state;
+  // 按 RFC 793 的建议由约每4微秒加一的时钟产生初始序号
+  tcb->iss = (uint32_t)(net_clock_us() / 4) + tcp_iss_offset;
+  tcp_iss_offset += 64000;
+  tcb->ts_offset = tcb->iss; // 时间戳的起点也按连接错开
+  tcb->snd_una = tcb->snd_nxt = tcb->iss;
+  tcb->buf_seq = tcb->iss + 1; // SYN 占用一个序号
+  tcb->snd_mss = TCP_MSS_DEFAULT;
+  tcb->rto_ms = TCP_RTO_INIT_MS;
+  tcb->delivered_us = tcb->first_sent_us = net_clock_us();
+  tcb->cc = tcp_cc_find(TCP_CC_DEFAULT);
+  tcb->cc->init(tcb);
+  return tcb;
+}
+
+/**
+ * @brief 内部函数，释放一个连接，之后不能再使用该TCB
+ *
+ * @param tcb 要释放的连接
+ */
+static void tcp_tcb_free(tcp_tcb_t *tcb) {
+  timer_del(&tcb->timer);
+  timer_del(&tcb->pace_timer);
+  map_delete(&tcp_table, &tcb->key);
+  free(tcb->snd_buf);
+  free(tcb->rtx);
+  for (uint32_t i = 0; i < tcb->ooo_cnt; i++)
+    buf_free(&tcb->ooo[i].buf);
+  free(tcb->ooo);
+  free(tcb);
+}
+
+/**
+ * @brief 内部函数，把数据追加到发送缓冲区，空间不足时先整理再扩容
+ *
+ * @param tcb 连接
+ * @param data 数据
+ * @param len 数据长度
+ * @return uint32_t 实际追加的长度，缓冲区达到上限时可能小于len
+ */
+static uint32_t tcp_sndbuf_append(tcp_tcb_t *tcb, uint8_t *data,
+                                  uint32_t len) {
+  if (len > TCP_SND_BUF_SIZE - tcb->snd_len)
+    len = TCP_SND_BUF_SIZE - tcb->snd_len;
+  if (tcb->snd_off + tcb->snd_len + len > tcb->snd_cap) {
+    if (tcb->snd_off) { // 已确认的数据留下的空洞，前移一次即可回收
+      memmove(tcb->snd_buf, tcb->snd_buf + tcb->snd_off, tcb->snd_len);
+      tcb->snd_off = 0;
+    }
+    if (tcb->snd_len + len > tcb->snd_cap) {
+      uint32_t cap = tcb->snd_cap ? tcb->snd_cap : 4096;
+      while (cap < tcb->snd_len + len)
+        cap *= 2;
+      if (cap > TCP_SND_BUF_SIZE)
+        cap = TCP_SND_BUF_SIZE;
+      uint8_t *p = realloc(tcb->snd_buf, cap);
+      if (!p)
+        return 0;
+      tcb->snd_buf = p;
+      tcb->snd_cap = cap;
+    }
   }
-  // 如果要发送 ACK 则发送（顺带 ACK ）
-  if (ack) {
-    hdr->flags = (hdr->flags | FLAG_ACK);
-    hdr->ackno = swap32(ackno);
+  memcpy(tcb->snd_buf + tcb->snd_off + tcb->snd_len, data, len);
+  tcb->snd_len += len;
+  return len;
+}
+
+/**
+ * @brief 内部函数，计算要通告的接收窗口并记录窗口右沿。
+ * 收到的按序数据立即交给回调函数，所以接收缓冲区总是空闲的；
+ * 已通告的右沿不会左移（RFC 7323 第2.4节）
+ *
+ * @param tcb 连接
+ * @param syn 是否为 SYN 报文，SYN 中的窗口不经扩大
+ * @return uint16_t 首部中的窗口字段
+ */
+static uint16_t tcp_rcv_window(tcp_tcb_t *tcb, int syn) {
+  uint32_t wnd = TCP_RCV_BUF_SIZE;
+  if (TCP_SEQ_LT(tcb->rcv_nxt + wnd, tcb->rcv_adv))
+    wnd = tcb->rcv_adv - tcb->rcv_nxt;
+  uint8_t shift = syn ? 0 : tcb->rcv_wscale;
+  if ((wnd >> shift) > UINT16_MAX)
+    wnd = (uint32_t)UINT16_MAX << shift;
+  // 右移舍去的部分不算已通告
+  uint32_t adv = tcb->rcv_nxt + ((wnd >> shift) << shift);
+  if (TCP_SEQ_GT(adv, tcb->rcv_adv))
+    tcb->rcv_adv = adv;
+  return wnd >> shift;
+}
+
+/**
+ * @brief 内部函数，发送一个报文段，数据取自发送缓冲区
+ *
+ * @param tcb 连接
+ * @param seq 报文段的序号
+ * @param len 数据长度
+ * @param flags 标志位
+ */
+static void tcp_xmit(tcp_tcb_t *tcb, uint32_t seq, uint32_t len,
+                     uint8_t flags) {
+  buf_t buf = {0};
+  if (buf_init(&buf, len) < 0)
+    return;
+  uint32_t sum = 0;
+  if (len) // 拷贝数据的同时累加校验和，不必再遍历一遍
+    sum = checksum_copy(buf.data,
+                        tcb->snd_buf + tcb->snd_off + (seq - tcb->buf_seq),
+                        len, 0);
+  uint8_t opt[TCP_OPT_MAX_LEN];
+  uint8_t opt_len = tcp_opt_build(tcb, flags, len, opt);
+  if (flags & FLAG_ACK)
+    tcb->last_ack_sent = tcb->rcv_nxt;
+  tcp_out(&buf, tcb->key.local_port, tcb->key.remote_ip, tcb->key.remote_port,
+          seq, tcb->rcv_nxt, flags, tcp_rcv_window(tcb, flags & FLAG_SYN), opt,
+          opt_len, sum);
+  buf_free(&buf);
+}
+
+/**
+ * @brief 内部函数，在重传队列末尾追加一个报文段，队列满时扩容
+ *
+ * @param tcb 连接
+ * @param seq 起始序号
+ * @param len 占用的序号数
+ * @param flags 标志位
+ * @return tcp_seg_t* 新的报文段，失败为NULL
+ */
+static tcp_seg_t *tcp_rtx_push(tcp_tcb_t *tcb, uint32_t seq, uint32_t len,
+                               uint8_t flags) {
+  if (tcb->rtx_cnt == tcb->rtx_cap) {
+    uint32_t cap = tcb->rtx_cap ? tcb->rtx_cap * 2 : 16;
+    tcp_seg_t *rtx = malloc(cap * sizeof(tcp_seg_t));
+    if (!rtx)
+      return NULL;
+    for (uint32_t i = 0; i < tcb->rtx_cnt; i++) // 展开成从0开始
+      rtx[i] = tcb->rtx[(tcb->rtx_head + i) & (tcb->rtx_cap - 1)];
+    free(tcb->rtx);
+    tcb->rtx = rtx;
+    tcb->rtx_cap = cap;
+    tcb->rtx_head = 0;
   }
+  tcp_seg_t *seg =
+      &tcb->rtx[(tcb->rtx_head + tcb->rtx_cnt++) & (tcb->rtx_cap - 1)];
+  seg->seq = seq;
+  seg->len = len;
+  seg->flags = flags;
+  seg->rexmit = 0;
+  seg->sacked = 0;
+  seg->counted = 0;
+  return seg;
+}
 
-  // 校验和
-  hdr->checksum16 = 0;
-  hdr->checksum16 = swap16(tcp_checksum(buf, net_if_ip, dst_ip));
+/**
+ * @brief 内部函数，获取重传队列中最早的报文段
+ *
+ * @param tcb 连接
+ * @return tcp_seg_t* 报文段，队列为空时为NULL
+ */
+static inline tcp_seg_t *tcp_rtx_head(tcp_tcb_t *tcb) {
+  return tcb->rtx_cnt ? &tcb->rtx[tcb->rtx_head] : NULL;
+}
+
+/**
+ * @brief 内部函数，（重新）发送重传队列中的一个报文段
+ *
+ * @param tcb 连接
+ * @param seg 报文段
+ */
+static void tcp_seg_xmit(tcp_tcb_t *tcb, tcp_seg_t *seg) {
+  uint8_t flags = seg->flags;
+  uint32_t len = seg->len - ((flags & FLAG_SYN) ? 1 : 0) -
+                 ((flags & FLAG_FIN) ? 1 : 0);
+  if (tcb->state != TCP_SYN_SENT) // 同时打开后重发的 SYN 也要带上确认
+    flags |= FLAG_ACK;
+  tcp_xmit(tcb, seg->seq, len, flags);
+  seg->sent_us = net_clock_us();
+  seg->delivered = tcb->delivered;
+  seg->delivered_us = tcb->delivered_us;
+  seg->first_sent_us = tcb->first_sent_us;
+}
+
+/**
+ * @brief 内部函数，（重新）启动超时重传定时器
+ *
+ * @param tcb 连接
+ */
+static inline void tcp_rto_arm(tcp_tcb_t *tcb) {
+  timer_add(&tcb->timer, tcb->rto_ms, tcp_timer_expire, tcb);
+}
 
-  // 启动超时重传检测
-  if (!retrans_time_cnt_on // 简单实现起见，一次只重传一个帧
-      && (syn || fin || buf->len - TCP_HEADER_LEN > 0)) { // 不对 ACK 进行重传
-    buf_init(&restrans_sent_data, buf->len);
-    memcpy(restrans_sent_data.data, buf->data, buf->len);
-    retrans_time_cnt_on = 1;
-    start = time(NULL);
+/**
+ * @brief 内部函数，（重新）启动坚持定时器
+ *
+ * @param tcb 连接
+ */
+static inline void tcp_persist_arm(tcp_tcb_t *tcb) {
+  timer_add(&tcb->timer, tcb->persist_ms, tcp_timer_expire, tcb);
+}
+
+/**
+ * @brief 内部函数，用一个 RTT 测量值更新超时重传时间，见 RFC 6298 第2节
+ *
+ * @param tcb 连接
+ * @param rtt_us 测量值，微秒
+ */
+static void tcp_rtt_sample(tcp_tcb_t *tcb, uint32_t rtt_us) {
+  if (rtt_us == 0)
+    rtt_us = 1; // srtt_us 为0表示没有测量值
+  if (tcb->srtt_us == 0) {
+    tcb->srtt_us = rtt_us;
+    tcb->rttvar_us = rtt_us / 2;
+  } else {
+    uint32_t err = tcb->srtt_us > rtt_us ? tcb->srtt_us - rtt_us
+                                         : rtt_us - tcb->srtt_us;
+    tcb->rttvar_us = (3 * tcb->rttvar_us + err) / 4;
+    tcb->srtt_us = (7 * tcb->srtt_us + rtt_us) / 8;
   }
+  // 时钟粒度 G 为时间轮的1毫秒
+  uint32_t var_us = 4 * tcb->rttvar_us > 1000 ? 4 * tcb->rttvar_us : 1000;
+  uint32_t rto_ms = (tcb->srtt_us + var_us + 999) / 1000;
+  if (rto_ms < TCP_RTO_MIN_MS)
+    rto_ms = TCP_RTO_MIN_MS;
+  if (rto_ms > TCP_RTO_MAX_MS)
+    rto_ms = TCP_RTO_MAX_MS;
+  tcb->rto_ms = rto_ms;
+  if (tcb->cc->on_rtt)
+    tcb->cc->on_rtt(tcb, rtt_us);
+}
 
-  // 发送数据
-  ip_out(buf, dst_ip, NET_PROTOCOL_TCP);
+/**
+ * @brief 内部函数，从重传队列中移除被确认的报文段，测量 RTT 和交付速率。
+ * 按 Karn 算法，被确认的报文段中有重传过的就不测量 RTT；
+ * 交付速率为最后一个被确认的报文段发出后到现在交付的字节数，除以这期间
+ * 发送和确认两段时间中较长的一段，免得确认挤在一起到达时高估速率
+ *
+ * @param tcb 连接
+ * @param ack 确认号，须大于 snd_una
+ * @param opts 报文中的选项，Karn 算法不能测量时由回显的时间戳测量 RTT
+ * @param rs 出口参数，交给拥塞控制模块的测量值
+ */
+static void tcp_rtx_ack(tcp_tcb_t *tcb, uint32_t ack, tcp_opts_t *opts,
+                        tcp_rate_sample_t *rs) {
+  tcp_seg_t *seg, last = {0};
+  int ambiguous = 0;
+  uint32_t newly = 0; // SACK 过的在当时已计入 delivered，这里不再计入
+  while ((seg = tcp_rtx_head(tcb)) && TCP_SEQ_LEQ(seg->seq + seg->len, ack)) {
+    if (!seg->sacked) {
+      ambiguous |= seg->rexmit;
+      last = *seg;
+    }
+    if (!seg->counted)
+      newly += seg->len;
+    tcb->rtx_head = (tcb->rtx_head + 1) & (tcb->rtx_cap - 1);
+    tcb->rtx_cnt--;
+  }
+  if (seg && TCP_SEQ_LT(seg->seq, ack)) { // 对方只确认了报文段的前一部分
+    if (!seg->counted)
+      newly += ack - seg->seq;
+    seg->len -= ack - seg->seq;
+    seg->seq = ack;
+  }
+
+  uint64_t now = net_clock_us();
+  rs->acked = ack - tcb->snd_una;
+  rs->prior_inflight = tcb->snd_nxt - tcb->snd_una;
+  rs->prior_delivered = last.sent_us ? last.delivered : tcb->delivered;
+  rs->delivery_rate = 0;
+  tcb->delivered += newly;
+  tcb->delivered_us = now;
+  if (last.sent_us) {
+    uint64_t ack_us = now - last.delivered_us;
+    uint64_t send_us = last.sent_us - last.first_sent_us;
+    uint64_t interval = ack_us > send_us ? ack_us : send_us;
+    if (interval)
+      rs->delivery_rate =
+          (tcb->delivered - last.delivered) * 1000000 / interval;
+    tcb->first_sent_us = last.sent_us;
+  }
+  uint32_t ts_rtt_us;
+  if (last.sent_us && !ambiguous)
+    tcp_rtt_sample(tcb, now - last.sent_us);
+  else if ((ts_rtt_us = tcp_opt_ts_rtt_us(tcb, opts)))
+    tcp_rtt_sample(tcb, ts_rtt_us);
 }
 
 /**
- * @brief 发送 tcp 报文
+ * @brief 内部函数，按收到的 SACK 块标记重传队列中对方已收到的报文段，
+ * 并计入已交付的字节数，免得空缺补上时累计确认一下跳过很多数据而高估交付速率。
+ * 越出 [snd_una, snd_nxt] 的块视为无效，忽略
  *
- * @param data  要发送的数据
- * @param len   数据长度
- * @param src_port 源端口
- * @param dst_ip 目的ip地址
- * @param dst_port 目的端口
+ * @param tcb 连接
+ * @param opts 收到的选项
  */
-void tcp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip,
-              uint16_t dst_port) {
-  int syn = 0, fin = 0, ack = 0;
-  buf_t buf;
-  buf_init(&buf, len);
-  if (data)
-    memcpy(buf.data, data, len);
+static void tcp_sack_in(tcp_tcb_t *tcb, tcp_opts_t *opts) {
+  for (int b = 0; b < opts->sack_cnt; b++) {
+    uint32_t left = opts->sack[b][0], right = opts->sack[b][1];
+    if (TCP_SEQ_GEQ(left, right) || TCP_SEQ_LT(left, tcb->snd_una) ||
+        TCP_SEQ_GT(right, tcb->snd_nxt))
+      continue;
+    for (uint32_t i = 0; i < tcb->rtx_cnt; i++) {
+      tcp_seg_t *seg = &tcb->rtx[(tcb->rtx_head + i) & (tcb->rtx_cap - 1)];
+      if (TCP_SEQ_GEQ(seg->seq, right))
+        break;
+      if (!seg->sacked && TCP_SEQ_GEQ(seg->seq, left) &&
+          TCP_SEQ_LEQ(seg->seq + seg->len, right)) {
+        seg->sacked = 1;
+        if (!seg->counted) { // 对方丢弃后再次 SACK 的不重复计入
+          seg->counted = 1;
+          tcb->delivered += seg->len;
+          tcb->delivered_us = net_clock_us();
+        }
+      }
+    }
+  }
+}
 
-  // 还没开始链接，发送
-  if (!syn_receive && !syn_send && !is_server) { // for client
-    syn = 1;
-    syn_send = true;
-    is_end = false;
+/**
+ * @brief 内部函数，丢包恢复中按 SACK 记分板估计在途的字节数（RFC 6675 的
+ * pipe），并找出下一个该重传的空缺。超时后未被 SACK 的都视为丢失，
+ * 否则其后至少有 TCP_DUPACK_THRESH 个报文段被 SACK 才算丢失
+ *
+ * @param tcb 连接
+ * @param pipe 出口参数，在途的字节数
+ * @return tcp_seg_t* 序号最小的未重传的丢失报文段，没有为NULL
+ */
+static tcp_seg_t *tcp_sack_scan(tcp_tcb_t *tcb, uint32_t *pipe) {
+  tcp_seg_t *next = NULL;
+  uint32_t sacked_above = 0;
+  *pipe = 0;
+  for (uint32_t i = tcb->rtx_cnt; i-- > 0;) {
+    tcp_seg_t *seg = &tcb->rtx[(tcb->rtx_head + i) & (tcb->rtx_cap - 1)];
+    if (seg->sacked) {
+      sacked_above++;
+      continue;
+    }
+    int lost = tcb->ca_state == TCP_CA_LOSS
+                   ? TCP_SEQ_LT(seg->seq, tcb->recover)
+                   : sacked_above >= TCP_DUPACK_THRESH;
+    int retransmitted = TCP_SEQ_LT(seg->seq, tcb->high_rxt);
+    if (!lost || retransmitted)
+      *pipe += seg->len;
+    if (lost && !retransmitted)
+      next = seg;
   }
-  if (!syn_send && syn_receive && is_server) { // for server
-    syn = 1;
-    syn_send = true;
-    is_end = false;
+  return next;
+}
+
+/**
+ * @brief 内部函数，重传一个丢失的报文段，记下本次恢复重传到的位置
+ *
+ * @param tcb 连接
+ * @param seg 报文段
+ */
+static void tcp_retransmit(tcp_tcb_t *tcb, tcp_seg_t *seg) {
+  seg->rexmit = 1;
+  tcp_seg_xmit(tcb, seg);
+  if (TCP_SEQ_GT(seg->seq + seg->len, tcb->high_rxt))
+    tcb->high_rxt = seg->seq + seg->len;
+}
+
+/**
+ * @brief 内部函数，发送新的报文段并记入重传队列，重传定时器未启动时启动之
+ *
+ * @param tcb 连接
+ * @param len 数据长度
+ * @param flags 标志位
+ * @return int 成功为0，重传队列无法扩容为-1
+ */
+static int tcp_send_new(tcp_tcb_t *tcb, uint32_t len, uint8_t flags) {
+  uint32_t seg_len =
+      len + ((flags & FLAG_SYN) ? 1 : 0) + ((flags & FLAG_FIN) ? 1 : 0);
+  tcp_seg_t *seg = tcp_rtx_push(tcb, tcb->snd_nxt, seg_len, flags);
+  if (!seg)
+    return -1;
+  tcp_seg_xmit(tcb, seg);
+  tcb->snd_nxt += seg_len;
+  if (!timer_pending(&tcb->timer) || tcb->rtx_cnt == 1)
+    tcp_rto_arm(tcb); // 重传队列原先为空时定时器可能是坚持定时器，改为超时重传
+  return 0;
+}
+
+/**
+ * @brief 内部函数，按当前状态和窗口发送能发送的报文段，需要时再发送确认
+ *
+ * @param tcb 连接
+ */
+static void tcp_output(tcp_tcb_t *tcb) {
+  if (tcb->delivering)
+    return; // 确认号要越过乱序队列中接上的部分，交付完由 tcp_segment_in 发送
+  uint64_t now = net_clock_us();
+  if (tcb->state == TCP_SYN_SENT || tcb->state == TCP_SYN_RCVD) {
+    if (tcb->snd_nxt == tcb->iss) // SYN 只在这里发送一次，之后由重传队列重发
+      tcp_send_new(tcb, 0, FLAG_SYN);
+    tcb->ack_now = 0;
+    return;
+  }
+  if (tcb->state == TCP_TIME_WAIT) {
+    if (tcb->ack_now)
+      tcp_xmit(tcb, tcb->snd_nxt, 0, FLAG_ACK);
+    tcb->ack_now = 0;
+    return;
   }
 
-  // 如果要发送 ACK 则发送（顺带 ACK ）
-  ack = should_ack;
-  should_ack = false;
+  // 在窗口内连续发送，直到窗口用完或缓冲区中的数据都已发出。
+  // 丢包恢复中有 SACK 时先按记分板重传空缺，在途的数据按 pipe 计算；
+  // 没有 SACK 时恢复完成之前不发新数据，否则会落在对方的空缺之后
+  uint64_t rate = tcb->cc->pacing_rate(tcb);
+  if (rate && tcb->pace_next_us < now)
+    tcb->pace_next_us = now; // 空闲期间不积累发送额度
+  while (tcb->ca_state == TCP_CA_OPEN || tcb->sack_ok) {
+    if (rate && tcb->pace_next_us > now + TCP_PACING_QUANTUM_US) {
+      // 超前太多，等速率允许时再发
+      if (!timer_pending(&tcb->pace_timer))
+        timer_add(&tcb->pace_timer,
+                  (tcb->pace_next_us - now + 999) / 1000, tcp_pace_expire,
+                  tcb);
+      break;
+    }
+    uint32_t flight = tcb->snd_nxt - tcb->snd_una;
+    uint32_t pipe = flight;
+    if (tcb->ca_state != TCP_CA_OPEN) {
+      tcp_seg_t *seg = tcp_sack_scan(tcb, &pipe);
+      if (pipe + tcb->snd_mss > tcb->cwnd)
+        break;
+      if (seg) {
+        tcp_retransmit(tcb, seg);
+        tcp_stats.sack_retransmits++;
+        if (rate)
+          tcb->pace_next_us +=
+              (uint64_t)(seg->len + TCP_HEADER_LEN) * 1000000 / rate;
+        continue;
+      }
+    }
+    uint32_t off = tcb->snd_nxt - tcb->buf_seq;
+    if (off > tcb->snd_len)
+      break; // FIN 已经发出
+    // 对方窗口限制所有未确认的数据，拥塞窗口限制在途的数据
+    uint32_t usable = tcb->snd_wnd > flight ? tcb->snd_wnd - flight : 0;
+    if (tcb->cwnd < pipe + usable)
+      usable = tcb->cwnd > pipe ? tcb->cwnd - pipe : 0;
+    uint32_t len = tcb->snd_len - off;
+    if (len > tcb->snd_mss)
+      len = tcb->snd_mss;
+    if (len > usable) {
+      // 避免糊涂窗口综合症（RFC 1122 4.2.3.4）：还有数据在途时，
+      // 窗口只够发送不满一个 MSS 的报文段就等下一个确认
+      if (flight)
+        break;
+      len = usable;
+    }
+    uint8_t flags = FLAG_ACK;
+    if (tcb->fin_queued && off + len == tcb->snd_len)
+      flags |= FLAG_FIN;
+    if (len == 0 && !(flags & FLAG_FIN))
+      break;
+    if (tcp_send_new(tcb, len, flags) < 0)
+      break;
+    tcb->ack_now = 0;
+    if (rate)
+      tcb->pace_next_us += (uint64_t)(len + TCP_HEADER_LEN) * 1000000 / rate;
+  }
+  if (tcb->ack_now) {
+    tcp_xmit(tcb, tcb->snd_nxt, 0, FLAG_ACK);
+    tcb->ack_now = 0;
+  }
+  // 对方窗口为零而还有数据未发出，由坚持定时器发送探测报文
+  if (tcb->rtx_cnt == 0 && tcb->snd_nxt - tcb->buf_seq < tcb->snd_len &&
+      !timer_pending(&tcb->timer)) {
+    tcb->persist_ms = tcb->rto_ms;
+    tcb->probes = 0;
+    tcp_persist_arm(tcb);
+  }
+}
 
-  // 对方链接关闭
-  if (fin_receive && !fin_send) {
-    fin = 1;
-    fin_send = true;
+/**
+ * @brief 内部函数，坚持定时器到期，发送零窗口探测。探测报文段不带数据，
+ * 序号为 snd_una - 1，与 Linux 相同。对方收到窗口外的报文段一定会回复确认，
+ * 确认中带有当前的窗口。探测不占序号，不进重传队列，不算作丢包，
+ * 也不影响拥塞窗口。对方一直回复确认时连接一直保持（RFC 1122 第4.2.2.17节），
+ * 连续 TCP_MAX_RETRIES 次没有回应才放弃
+ *
+ * @param tcb 连接
+ */
+static void tcp_persist_expire(tcp_tcb_t *tcb) {
+  if (tcb->snd_wnd) { // 窗口已经打开，照常发送
+    tcp_output(tcb);
+    return;
   }
+  if (++tcb->probes > TCP_MAX_RETRIES) {
+    tcp_tcb_free(tcb);
+    return;
+  }
+  tcp_xmit(tcb, tcb->snd_una - 1, 0, FLAG_ACK);
+  tcb->persist_ms = tcb->persist_ms * 2 < TCP_RTO_MAX_MS ? tcb->persist_ms * 2
+                                                         : TCP_RTO_MAX_MS;
+  tcp_persist_arm(tcb);
+}
+
+/**
+ * @brief 限速定时器回调，继续发送被限速推迟的报文段
+ *
+ * @param timer 到期的定时器
+ */
+static void tcp_pace_expire(net_timer_t *timer) { tcp_output(timer->arg); }
+
+/**
+ * @brief 超时重传定时器回调，由时间轮在超时时调用。
+ * 重传最早的未确认报文段并加倍超时重传时间，其余已发出的报文段视为丢失，
+ * 之后每收到一个推进 snd_una 的确认就重传下一个；重传队列为空时是坚持定时器，
+ * 见 tcp_persist_expire；TIME_WAIT 状态下则是 2MSL 到期，释放连接
+ *
+ * @param timer 到期的定时器
+ */
+static void tcp_timer_expire(net_timer_t *timer) {
+  tcp_tcb_t *tcb = timer->arg;
+  tcp_seg_t *seg = tcp_rtx_head(tcb);
+  if (tcb->state != TCP_TIME_WAIT && !seg) {
+    tcp_persist_expire(tcb);
+    return;
+  }
+  if (tcb->state != TCP_TIME_WAIT && seg->sacked) {
+    // 最早的未确认报文段 SACK 过，对方确实丢弃了乱序队列中的数据。
+    // 清除所有 SACK 标记，恢复点之前的都按丢失重传；这是对方内存不足
+    // 而不是拥塞，不通知拥塞控制，也不算作一次重试。这些数据 SACK 时已计入
+    // delivered，counted 标记保留，之后确认或再次 SACK 时不重复计入
+    for (uint32_t i = 0; i < tcb->rtx_cnt; i++)
+      tcb->rtx[(tcb->rtx_head + i) & (tcb->rtx_cap - 1)].sacked = 0;
+    tcb->ca_state = TCP_CA_LOSS;
+    tcb->recover = tcb->snd_nxt;
+    tcb->high_rxt = tcb->snd_una;
+    tcp_retransmit(tcb, seg);
+    tcp_rto_arm(tcb);
+    return;
+  }
+  if (tcb->state == TCP_TIME_WAIT || ++tcb->retries > TCP_MAX_RETRIES) {
+    tcp_tcb_free(tcb);
+    return;
+  }
+  tcb->rto_ms = tcb->rto_ms * 2 < TCP_RTO_MAX_MS ? tcb->rto_ms * 2
+                                                 : TCP_RTO_MAX_MS;
+  // SACK 信息保留，超时后也只重传空缺
+  for (uint32_t i = 0; i < tcb->rtx_cnt; i++)
+    tcb->rtx[(tcb->rtx_head + i) & (tcb->rtx_cap - 1)].rexmit = 1;
+  if (tcb->ca_state != TCP_CA_LOSS) // 同一次丢失只让拥塞控制响应一次
+    tcb->cc->on_loss(tcb, 1);
+  tcb->ca_state = TCP_CA_LOSS;
+  tcb->recover = tcb->snd_nxt;
+  tcb->dupacks = 0;
+  tcb->high_rxt = tcb->snd_una;
+  tcp_stats.timeout_retransmits++;
+  tcp_retransmit(tcb, seg);
+  tcp_rto_arm(tcb);
+}
+
+/**
+ * @brief 内部函数，进入 TIME_WAIT 状态，2MSL 后释放连接
+ *
+ * @param tcb 连接
+ */
+static void tcp_time_wait(tcp_tcb_t *tcb) {
+  tcb->state = TCP_TIME_WAIT;
+  timer_add(&tcb->timer, TCP_TIME_WAIT_MS, tcp_timer_expire, tcb);
+}
+
+/**
+ * @brief 内部函数，连接的本端关闭：发完缓冲区中的数据后发送 FIN
+ *
+ * @param tcb 连接
+ * @return int 连接已被释放为1
+ */
+static int tcp_shutdown(tcp_tcb_t *tcb) {
+  switch (tcb->state) {
+  case TCP_SYN_SENT:
+    tcp_tcb_free(tcb);
+    return 1;
+  case TCP_SYN_RCVD:
+  case TCP_ESTABLISHED:
+    tcb->state = TCP_FIN_WAIT_1;
+    break;
+  case TCP_CLOSE_WAIT:
+    tcb->state = TCP_LAST_ACK;
+    break;
+  default:
+    return 0; // 已经关闭过
+  }
+  tcb->fin_queued = 1;
+  tcp_output(tcb);
+  return 0;
+}
+
+/**
+ * @brief 内部函数，处理不属于任何连接的报文：监听的端口收到 SYN 时新建连接，
+ * 否则回复 RST
+ *
+ * @param hdr tcp首部
+ * @param opts 报文中的选项
+ * @param seg_len 报文段占用的序号数
+ * @param src_ip 源ip地址
+ */
+static void tcp_listen_in(tcp_hdr_t *hdr, tcp_opts_t *opts, uint32_t seg_len,
+                          uint8_t *src_ip) {
+  uint16_t dst_port = swap16(hdr->dst_port16);
+  uint16_t src_port = swap16(hdr->src_port16);
+  uint32_t seq = swap32(hdr->seqno);
+  if (hdr->flags & FLAG_RST)
+    return;
+
+  tcp_port_t *port = map_get(&tcp_ports, &dst_port);
+  if (port && port->server && (hdr->flags & FLAG_SYN) &&
+      !(hdr->flags & FLAG_ACK)) {
+    tcp_key_t key;
+    tcp_key_init(&key, dst_port, src_ip, src_port);
+    tcp_tcb_t *tcb = tcp_tcb_new(&key, port->handler, TCP_SYN_RCVD);
+    if (!tcb)
+      return; // 连接表已满，当作没收到，对方会重传
+    tcb->irs = seq;
+    tcb->rcv_nxt = tcb->rcv_adv = seq + 1;
+    tcb->snd_wnd = swap16(hdr->win); // SYN 中的窗口不经扩大
+    tcb->snd_wl1 = seq;
+    tcp_opt_syn_in(tcb, opts);
+    tcp_output(tcb);
+    return;
+  }
+
+  if (hdr->flags & FLAG_ACK)
+    tcp_send_rst(src_ip, dst_port, src_port, swap32(hdr->ackno), 0, FLAG_RST);
+  else
+    tcp_send_rst(src_ip, dst_port, src_port, 0, seq + seg_len,
+                 FLAG_RST | FLAG_ACK);
+}
+
+/**
+ * @brief 内部函数，SYN_SENT 状态下处理收到的报文
+ *
+ * @param tcb 连接
+ * @param hdr tcp首部
+ * @param opts 报文中的选项
+ * @return int 连接已被释放为1
+ */
+static int tcp_syn_sent_in(tcp_tcb_t *tcb, tcp_hdr_t *hdr, tcp_opts_t *opts) {
+  uint32_t seq = swap32(hdr->seqno);
+  uint32_t ack = swap32(hdr->ackno);
+  if ((hdr->flags & FLAG_ACK) && ack != tcb->snd_nxt) {
+    if (!(hdr->flags & FLAG_RST))
+      tcp_send_rst(tcb->key.remote_ip, tcb->key.local_port,
+                   tcb->key.remote_port, ack, 0, FLAG_RST);
+    return 0;
+  }
+  if (hdr->flags & FLAG_RST) {
+    if (hdr->flags & FLAG_ACK) { // 连接被拒绝
+      tcp_tcb_free(tcb);
+      return 1;
+    }
+    return 0;
+  }
+  if (!(hdr->flags & FLAG_SYN))
+    return 0;
+
+  tcb->irs = seq;
+  tcb->rcv_nxt = tcb->rcv_adv = seq + 1;
+  tcb->snd_wnd = swap16(hdr->win);
+  tcb->snd_wl1 = seq;
+  tcb->snd_wl2 = ack;
+  tcb->ack_now = 1;
+  tcp_opt_syn_in(tcb, opts);
+  if (hdr->flags & FLAG_ACK) {
+    tcp_rate_sample_t rs;
+    tcp_rtx_ack(tcb, ack, opts, &rs);
+    tcb->snd_una = ack;
+    tcb->state = TCP_ESTABLISHED;
+    tcb->retries = 0;
+    tcb->ca_state = TCP_CA_OPEN; // SYN 超时重传过也已恢复，否则发不出新数据
+    timer_del(&tcb->timer);
+  } else { // 同时打开，重发的 SYN 带上确认
+    tcb->state = TCP_SYN_RCVD;
+    tcp_seg_xmit(tcb, tcp_rtx_head(tcb));
+  }
+  tcp_output(tcb);
+  return 0;
+}
+
+/**
+ * @brief 内部函数，判断报文段是否落在接收窗口内，见 RFC 793 第69页
+ *
+ * @param tcb 连接
+ * @param seq 报文段的序号
+ * @param seg_len 报文段占用的序号数
+ * @return int 可以接受为1
+ */
+static int tcp_acceptable(tcp_tcb_t *tcb, uint32_t seq, uint32_t seg_len) {
+  uint32_t wnd = tcb->rcv_adv - tcb->rcv_nxt;
+  if (seg_len == 0)
+    return wnd == 0 ? seq == tcb->rcv_nxt
+                    : TCP_SEQ_LEQ(tcb->rcv_nxt, seq) &&
+                          TCP_SEQ_LT(seq, tcb->rcv_nxt + wnd);
+  if (wnd == 0)
+    return 0;
+  uint32_t last = seq + seg_len - 1;
+  return (TCP_SEQ_LEQ(tcb->rcv_nxt, seq) &&
+          TCP_SEQ_LT(seq, tcb->rcv_nxt + wnd)) ||
+         (TCP_SEQ_LEQ(tcb->rcv_nxt, last) &&
+          TCP_SEQ_LT(last, tcb->rcv_nxt + wnd));
+}
+
+/**
+ * @brief 内部函数，把乱序到达的数据放入乱序队列。与已有数据重叠的部分
+ * 截去，窗口之外的部分丢弃，所以队列中的数据不超过接收窗口，
+ * 占用的 slab 不超过 TCP_OOO_MAX_SLABS
+ *
+ * @param tcb 连接
+ * @param seq 数据的序号，大于 rcv_nxt
+ * @param buf 数据，会被截短
+ * @param fin 数据之后是否紧跟着 FIN
+ */
+static void tcp_ooo_insert(tcp_tcb_t *tcb, uint32_t seq, buf_t *buf,
+                           int fin) {
+  tcb->sack_last = seq;
+  if (TCP_SEQ_GT(seq + buf->len, tcb->rcv_adv)) {
+    buf_remove_padding(buf, seq + buf->len - tcb->rcv_adv);
+    fin = 0;
+  }
+  // 每段数据都占着缓冲池中的一个 slab，超出连接的份额或缓冲池余量不足时
+  // 先丢弃序号最高的段（RFC 2018 允许接收方丢弃已 SACK 的数据），
+  // 离 rcv_nxt 近的数据更有用；新数据不比它们低就丢弃新数据，由对方重传
+  while (tcb->ooo_cnt && (tcb->ooo_cnt >= TCP_OOO_MAX_SLABS ||
+                          buf_pool_avail() < TCP_OOO_POOL_RESERVE)) {
+    tcp_ooo_t *last = &tcb->ooo[tcb->ooo_cnt - 1];
+    tcp_stats.ooo_drops++;
+    if (TCP_SEQ_GEQ(seq, last->seq))
+      return;
+    buf_free(&last->buf);
+    tcb->ooo_cnt--;
+  }
+  if (buf_pool_avail() < TCP_OOO_POOL_RESERVE) {
+    tcp_stats.ooo_drops++;
+    return;
+  }
+  uint32_t i = 0; // 新数据插入的位置
+  while (i < tcb->ooo_cnt && TCP_SEQ_LEQ(tcb->ooo[i].seq, seq))
+    i++;
+  if (i > 0) { // 去掉前一段已经有的部分
+    tcp_ooo_t *prev = &tcb->ooo[i - 1];
+    uint32_t prev_end = prev->seq + prev->buf.len;
+    if (TCP_SEQ_GEQ(prev_end, seq + buf->len)) {
+      prev->fin |= fin && prev_end == seq + buf->len;
+      return;
+    }
+    if (TCP_SEQ_GT(prev_end, seq)) {
+      buf_remove_header(buf, prev_end - seq);
+      seq = prev_end;
+    }
+  }
+  uint32_t end = seq + buf->len;
+  uint32_t j = i; // 被新数据完全覆盖的是[i, j)
+  while (j < tcb->ooo_cnt &&
+         TCP_SEQ_LEQ(tcb->ooo[j].seq + tcb->ooo[j].buf.len, end))
+    fin |= tcb->ooo[j++].fin;
+  if (j < tcb->ooo_cnt && TCP_SEQ_LT(tcb->ooo[j].seq, end)) {
+    buf_remove_padding(buf, end - tcb->ooo[j].seq); // 去掉后一段已经有的部分
+    fin = 0;
+  }
+  if (buf->len == 0 && !fin)
+    return;
+
+  tcp_ooo_t e = {.seq = seq, .fin = fin};
+  buf_ref(&e.buf, buf, 0); // 借用驱动存储区的 buf 会拷贝到缓冲池中
+  if (!e.buf.data)
+    return; // 缓冲池耗尽，由对方重传
+  if (j == i && tcb->ooo_cnt == tcb->ooo_cap) {
+    uint32_t cap = tcb->ooo_cap ? tcb->ooo_cap * 2 : 16;
+    tcp_ooo_t *ooo = realloc(tcb->ooo, cap * sizeof(tcp_ooo_t));
+    if (!ooo) {
+      buf_free(&e.buf);
+      return;
+    }
+    tcb->ooo = ooo;
+    tcb->ooo_cap = cap;
+  }
+  for (uint32_t k = i; k < j; k++)
+    buf_free(&tcb->ooo[k].buf);
+  memmove(&tcb->ooo[i + 1], &tcb->ooo[j],
+          (tcb->ooo_cnt - j) * sizeof(tcp_ooo_t));
+  tcb->ooo_cnt = tcb->ooo_cnt - (j - i) + 1;
+  tcb->ooo[i] = e;
+}
+
+/**
+ * @brief 内部函数，把乱序队列中与 rcv_nxt 相接的数据依次交给应用
+ *
+ * @param tcb 连接
+ * @return int 交付的数据之后紧跟着 FIN 为1
+ */
+static int tcp_ooo_deliver(tcp_tcb_t *tcb) {
+  uint32_t n = 0;
+  int fin = 0;
+  while (n < tcb->ooo_cnt && TCP_SEQ_LEQ(tcb->ooo[n].seq, tcb->rcv_nxt)) {
+    tcp_ooo_t *e = &tcb->ooo[n++];
+    uint32_t end = e->seq + e->buf.len;
+    if (TCP_SEQ_GT(end, tcb->rcv_nxt)) {
+      buf_remove_header(&e->buf, tcb->rcv_nxt - e->seq);
+      tcb->rcv_nxt = end;
+      if (tcb->handler)
+        tcb->handler(e->buf.data, e->buf.len, tcb->key.remote_ip,
+                     tcb->key.remote_port);
+    }
+    fin = e->fin && end == tcb->rcv_nxt;
+    buf_free(&e->buf);
+    if (fin)
+      break;
+  }
+  if (fin) { // FIN 之后不应再有数据
+    while (n < tcb->ooo_cnt)
+      buf_free(&tcb->ooo[n++].buf);
+  }
+  memmove(tcb->ooo, &tcb->ooo[n], (tcb->ooo_cnt - n) * sizeof(tcp_ooo_t));
+  tcb->ooo_cnt -= n;
+  return fin;
+}
+
+/**
+ * @brief 内部函数，处理确认号：释放已确认的数据、更新窗口、推进关闭流程
+ *
+ * @param tcb 连接
+ * @param hdr tcp首部
+ * @param opts 报文中的选项
+ * @param len 报文段的数据长度
+ * @return int 连接已被释放为1
+ */
+static int tcp_ack_in(tcp_tcb_t *tcb, tcp_hdr_t *hdr, tcp_opts_t *opts,
+                      uint32_t len) {
+  uint32_t seq = swap32(hdr->seqno);
+  uint32_t ack = swap32(hdr->ackno);
+  if (TCP_SEQ_GT(ack, tcb->snd_nxt)) { // 确认了还没发送的数据
+    tcb->ack_now = 1;
+    return 0;
+  }
+  tcb->probes = 0; // 对方还在回应，零窗口探测不会放弃连接
+  if (tcb->state == TCP_SYN_RCVD) {
+    if (TCP_SEQ_LEQ(ack, tcb->snd_una)) {
+      tcp_send_rst(tcb->key.remote_ip, tcb->key.local_port,
+                   tcb->key.remote_port, ack, 0, FLAG_RST);
+      return 0;
+    }
+    tcb->state = TCP_ESTABLISHED;
+  }
+
+  if (tcb->sack_ok && opts->sack_cnt)
+    tcp_sack_in(tcb, opts);
+  int advanced = TCP_SEQ_GT(ack, tcb->snd_una);
+  if (advanced) {
+    if (TCP_SEQ_GT(ack, tcb->buf_seq)) {
+      uint32_t acked = ack - tcb->buf_seq;
+      if (acked > tcb->snd_len)
+        acked = tcb->snd_len; // 多出的一个序号是 FIN
+      tcb->snd_off += acked;
+      tcb->snd_len -= acked;
+      tcb->buf_seq += acked;
+      if (tcb->snd_len == 0)
+        tcb->snd_off = 0;
+    }
+    tcp_rate_sample_t rs;
+    tcp_rtx_ack(tcb, ack, opts, &rs);
+    tcb->snd_una = ack;
+    tcb->retries = 0;
+    tcb->dupacks = 0;
+    if (tcb->ca_state != TCP_CA_OPEN && TCP_SEQ_LT(ack, tcb->recover)) {
+      // 部分确认：紧接着的报文段也丢了，立即重传，不等重复确认。
+      // 有 SACK 时不这样推测，新的最早报文段可能还在途中，
+      // 空缺都由 tcp_output 按记分板重传（RFC 6675）
+      if (!tcb->sack_ok) {
+        tcp_retransmit(tcb, tcp_rtx_head(tcb));
+        if (tcb->ca_state == TCP_CA_RECOVERY)
+          tcp_stats.partial_retransmits++;
+        else
+          tcp_stats.loss_retransmits++;
+      }
+    } else
+      tcb->ca_state = TCP_CA_OPEN;
+    tcb->cc->on_ack(tcb, &rs);
+    if (tcb->rtx_cnt)
+      tcp_rto_arm(tcb);
+    else
+      timer_del(&tcb->timer);
+  } else if (ack == tcb->snd_una && tcb->rtx_cnt && len == 0 &&
+             !(hdr->flags & (FLAG_SYN | FLAG_FIN)) &&
+             ((uint32_t)swap16(hdr->win) << tcb->snd_wscale) == tcb->snd_wnd) {
+    // 重复确认，定义见 RFC 5681 第2节
+    if (++tcb->dupacks == TCP_DUPACK_THRESH &&
+        tcb->ca_state == TCP_CA_OPEN) {
+      tcp_seg_t *seg = tcp_rtx_head(tcb);
+      tcb->cc->on_loss(tcb, 0);
+      tcb->ca_state = TCP_CA_RECOVERY;
+      tcb->recover = tcb->snd_nxt;
+      tcb->high_rxt = tcb->snd_una;
+      tcp_retransmit(tcb, seg);
+      tcp_rto_arm(tcb);
+      tcp_stats.fast_retransmits++;
+    }
+  }
+  tcp_seg_t *head = tcp_rtx_head(tcb);
+  if (tcb->sack_ok && advanced && head && head->sacked) {
+    // 累计确认前进后停在 SACK 过的报文段前，对方可能丢弃了乱序队列中的数据
+    // （RFC 2018 第8节），也可能只是在交付乱序数据的途中先发出了确认。
+    // 与 Linux 一样等上 srtt/4，其间的确认越过它就没事，否则由
+    // tcp_timer_expire 按丢弃处理。没前进的确认不算：满长的数据段放不下
+    // SACK 块，乱序到达的旧确认也没有
+    uint32_t wait_ms = tcb->srtt_us / 4000;
+    timer_add(&tcb->timer,
+              wait_ms > TCP_RENEGE_WAIT_MS ? wait_ms : TCP_RENEGE_WAIT_MS,
+              tcp_timer_expire, tcb);
+  }
+  if (TCP_SEQ_LT(tcb->snd_wl1, seq) ||
+      (tcb->snd_wl1 == seq && TCP_SEQ_LEQ(tcb->snd_wl2, ack))) {
+    tcb->snd_wnd = (uint32_t)swap16(hdr->win) << tcb->snd_wscale;
+    tcb->snd_wl1 = seq;
+    tcb->snd_wl2 = ack;
+  }
+
+  // FIN 被确认
+  if (tcb->fin_queued && ack == tcb->buf_seq + tcb->snd_len + 1) {
+    switch (tcb->state) {
+    case TCP_FIN_WAIT_1:
+      tcb->state = TCP_FIN_WAIT_2;
+      break;
+    case TCP_CLOSING:
+      tcp_time_wait(tcb);
+      break;
+    case TCP_LAST_ACK:
+      tcp_tcb_free(tcb);
+      return 1;
+    default:
+      break;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 内部函数，处理属于已有连接的报文
+ *
+ * @param tcb 连接
+ * @param buf 报文，首部已去掉
+ * @param hdr tcp首部
+ * @param opts 报文中的选项
+ */
+static void tcp_segment_in(tcp_tcb_t *tcb, buf_t *buf, tcp_hdr_t *hdr,
+                           tcp_opts_t *opts) {
+  uint32_t seq = swap32(hdr->seqno);
+  uint32_t seg_len = buf->len + ((hdr->flags & FLAG_SYN) ? 1 : 0) +
+                     ((hdr->flags & FLAG_FIN) ? 1 : 0);
+
+  if (tcb->state == TCP_SYN_SENT) {
+    tcp_syn_sent_in(tcb, hdr, opts);
+    return;
+  }
+  if (tcb->state == TCP_SYN_RCVD && (hdr->flags & FLAG_SYN) &&
+      seq == tcb->irs) { // 对方重传了 SYN，说明 SYN-ACK 丢了
+    if (tcp_rtx_head(tcb))
+      tcp_seg_xmit(tcb, tcp_rtx_head(tcb));
+    return;
+  }
+
+  // PAWS 拒绝的和窗口外的一样回复确认后丢弃，RST 不经 PAWS 检查
+  if (!tcp_acceptable(tcb, seq, seg_len) ||
+      (!(hdr->flags & FLAG_RST) && !tcp_opt_paws_ok(tcb, opts))) {
+    if (!(hdr->flags & FLAG_RST)) {
+      tcb->ack_now = 1;
+      tcp_output(tcb);
+    }
+    return;
+  }
+  if (hdr->flags & FLAG_RST) {
+    tcp_tcb_free(tcb);
+    return;
+  }
+  tcp_opt_ts_update(tcb, opts, seq);
+  if (hdr->flags & FLAG_SYN) { // 窗口内的 SYN，按 RFC 5961 回复确认而不复位
+    tcb->ack_now = 1;
+    tcp_output(tcb);
+    return;
+  }
+  if (!(hdr->flags & FLAG_ACK))
+    return;
+  if (tcp_ack_in(tcb, hdr, opts, buf->len))
+    return;
 
-  if (!fin && !syn && !len && !ack)
-    return; // 空报文
+  // 数据：按序到达的交给应用，再接上乱序队列中已经连续的部分；
+  // 乱序到达的放入乱序队列，立即回复的确认就是告诉对方空缺位置的重复确认。
+  // 应用在回调中发送的数据等全部交付后再发出，否则其中的确认号停在乱序队列
+  // 之前，对方会当作部分确认或 SACK 过的数据被丢弃
+  int fin = (hdr->flags & FLAG_FIN) != 0;
+  if (tcb->state == TCP_ESTABLISHED || tcb->state == TCP_FIN_WAIT_1 ||
+      tcb->state == TCP_FIN_WAIT_2) {
+    tcb->delivering = 1;
+    if (buf->len)
+      tcb->ack_now = 1;
+    if (buf->len && TCP_SEQ_LT(seq, tcb->rcv_nxt)) { // 去掉已经收到的部分
+      uint32_t dup = tcb->rcv_nxt - seq;
+      if (dup > buf->len)
+        dup = buf->len;
+      buf_remove_header(buf, dup);
+      seq += dup;
+    }
+    if (TCP_SEQ_GT(seq, tcb->rcv_nxt)) {
+      if (buf->len || fin) {
+        tcp_ooo_insert(tcb, seq, buf, fin);
+        tcb->ack_now = 1;
+      }
+      fin = 0; // 乱序的 FIN 随乱序队列一起处理
+    } else if (buf->len) {
+      tcb->rcv_nxt += buf->len;
+      if (tcb->handler)
+        tcb->handler(buf->data, buf->len, tcb->key.remote_ip,
+                     tcb->key.remote_port);
+      seq += buf->len;
+    }
+    if (!fin && tcb->ooo_cnt && seq == tcb->rcv_nxt && tcp_ooo_deliver(tcb)) {
+      fin = 1;
+      seq = tcb->rcv_nxt;
+    }
+    tcb->delivering = 0;
+  }
 
-  tcp_out(&buf, len, src_port, dst_ip, dst_port, syn, fin, ack);
+  // 按序到达的 FIN
+  if (fin && seq == tcb->rcv_nxt) {
+    tcb->rcv_nxt++;
+    tcb->ack_now = 1;
+    switch (tcb->state) {
+    case TCP_ESTABLISHED:
+      tcb->state = TCP_CLOSE_WAIT;
+      // 对方关闭后本端也随即关闭，应用不必另外调用 tcp_close
+      if (tcp_shutdown(tcb))
+        return;
+      break;
+    case TCP_FIN_WAIT_1:
+      if (tcb->snd_una == tcb->snd_nxt)
+        tcp_time_wait(tcb); // 我方的 FIN 已被确认
+      else
+        tcb->state = TCP_CLOSING;
+      break;
+    case TCP_FIN_WAIT_2:
+    case TCP_TIME_WAIT:
+      tcp_time_wait(tcb);
+      break;
+    default:
+      break;
+    }
+  }
+  tcp_output(tcb);
 }
 
 /**
@@ -177,9 +1242,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
   tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
   int head_len = (hdr->doff >> 4) * 4;
-
-  // 还没开始链接，则收到链接报文时做出处理，否则直接返回
-  if (!syn_receive && !(hdr->flags & FLAG_SYN))
+  if (head_len < TCP_HEADER_LEN || head_len > buf->len)
     return;
 
   // 校验checksum
@@ -191,158 +1254,142 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
   }
   hdr->checksum16 = checksum16_old;
 
-  if (syn_receive && swap32(hdr->seqno) != ackno)
-    return; // 未收到顺序包，丢弃。一个简单的保证接收方可靠传输的 solution
-
-  if (hdr->flags & FLAG_ACK) {
-    if (syn_send && seq != swap32(hdr->ackno))
-      return; // 简单地保障当前帧先被传出去再发下一个，从而简单地实现超时重传
-    peer_ack = swap32(hdr->ackno);
-    should_ack = false;
-    retrans_time_cnt_on = 0;
-  }
-  peer_seq = swap32(hdr->seqno);
-
-  // 收到链接报文
-  if (hdr->flags & FLAG_SYN) {
-    fin_receive = false;
-    syn_receive = true;
-    is_end = false;
-    should_ack = true;
-  }
-  // 收到终止报文
-  if (hdr->flags & FLAG_FIN) {
-    fin_receive = true;
-    should_ack = true;
-  }
-  // 收到终止报文确认
-  if (fin_send && fin_receive && (hdr->flags & FLAG_ACK)) {
-    is_end = true;
-  }
-
-  if (buf->len > head_len ||
-      ((hdr->flags & FLAG_FIN) ||
-       (hdr->flags & FLAG_SYN))) { // 只对有实际长度（有 payload 或者有 fin syn
-                                   // 标志）的报文进行确认
-    ackno = peer_seq + ((hdr->flags & FLAG_FIN) ? 1 : 0) +
-            ((hdr->flags & FLAG_SYN) ? 1 : 0) + buf->len - head_len;
-    should_ack = true;
-  }
-
-  // 更新 window size
-  if (swap16(hdr->win) < 4)
-    window_size = swap16(hdr->win);
-  else
-    window_size = 4;
-
-  // 递交数据到上层
-  uint16_t dst_port16 = swap16(hdr->dst_port16);
-  uint16_t src_port16 = swap16(hdr->src_port16);
-
-  tcp_handler_t *handler = map_get(&tcp_table, &dst_port16);
-  if (buf->len > TCP_HEADER_LEN && handler == NULL) {
-    buf_add_header(buf, sizeof(ip_hdr_t));
-    icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
-  }
-  if (handler) {
-    buf_remove_header(buf, head_len);
-    (*handler)(buf->data, buf->len, src_ip, src_port16);
-  }
-
-  if ((fin_receive || fin_send || is_end || (syn_receive && !syn_send) ||
-       (!syn_receive &&
-        !syn_send))) { // 发送 syn 或 fin 或空 ack 报文，不带数据
-    tcp_send(NULL, 0, dst_port16, src_ip, src_port16);
-    if (is_end)
-      tcp_rst();
+  // 首部在去掉之前拷贝出来，处理数据时可能被回调函数复用的缓冲区覆盖
+  tcp_hdr_t h = *hdr;
+  tcp_opts_t opts;
+  tcp_opt_parse(hdr, head_len, &opts);
+  buf_remove_header(buf, head_len);
+  tcp_tcb_t *tcb =
+      tcp_lookup(swap16(h.dst_port16), src_ip, swap16(h.src_port16));
+  if (!tcb) {
+    tcp_listen_in(&h, &opts,
+                  buf->len + ((h.flags & FLAG_SYN) ? 1 : 0) +
+                      ((h.flags & FLAG_FIN) ? 1 : 0),
+                  src_ip);
     return;
   }
-
-  // fill window
-  uint8_t new_data[QUEUE_MAX_SIZE];
-  int ori_size = (outstream.size > window_size ? window_size : outstream.size);
-  for (int i = 0; i < ori_size; ++i) {
-    new_data[i] = queue_front(&outstream);
-    queue_pop(&outstream);
-  }
-  if (ori_size > 0)
-    should_ack = true;
-  tcp_send(new_data, ori_size, dst_port16, src_ip, src_port16);
-
-  if (is_end)
-    tcp_rst();
+  tcp_segment_in(tcb, buf, &h, &opts);
 }
 
 /**
- * @brief 提升 TCP class 时间过去
+ * @brief 发送 tcp 数据，数据先进入连接的发送缓冲区，再按窗口发出
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口
+ * @return int 放入发送缓冲区的字节数，缓冲区满时可能小于len；连接不存在或
+ * 已关闭为-1
  */
-void tcp_tick() { // 由 net class 周期性调用
-  if (!retrans_time_cnt_on)
-    return;
-  time_t cur_time = time(NULL);
-  if (cur_time - start >= RETRANSMISSON_TIMEOUT) { // 超时
-    uint8_t dst_ip[NET_IP_LEN] = {10, 250, 196, 1};
-    buf_t retrans_tmp_buf;
-    buf_init(&retrans_tmp_buf, restrans_sent_data.len);
-    memcpy(retrans_tmp_buf.data, restrans_sent_data.data,
-           restrans_sent_data.len);
-    ip_out(&retrans_tmp_buf, dst_ip, NET_PROTOCOL_TCP); // 重传
-    start = cur_time;
-  }
+int tcp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip,
+             uint16_t dst_port) {
+  tcp_tcb_t *tcb = tcp_lookup(src_port, dst_ip, dst_port);
+  if (!tcb || tcb->fin_queued)
+    return -1;
+  int n = tcp_sndbuf_append(tcb, data, len);
+  tcp_output(tcb);
+  return n;
 }
 
 /**
- * @brief tcp client 发送连接请求
+ * @brief 主动打开一个连接（发送 SYN），本地端口须先用 tcp_open 打开
  *
- * @param port 目标端口号
+ * @param src_port 本地端口
  * @param dst_ip 目标ip地址
+ * @param dst_port 目标端口
+ * @return int 成功为0，失败为-1
  */
-void tcp_connect(uint16_t port, uint8_t *dst_ip) {
-  printf("connect!\n");
-  tcp_send(NULL, 0, 60000, dst_ip, port);
+int tcp_connect(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+  tcp_port_t *port = map_get(&tcp_ports, &src_port);
+  if (!port || tcp_lookup(src_port, dst_ip, dst_port))
+    return -1;
+  tcp_key_t key;
+  tcp_key_init(&key, src_port, dst_ip, dst_port);
+  tcp_tcb_t *tcb = tcp_tcb_new(&key, port->handler, TCP_SYN_SENT);
+  if (!tcb)
+    return -1;
+  tcp_output(tcb);
+  return 0;
 }
 
 /**
  * @brief 打开一个 tcp 端口并注册处理程序
  *
  * @param port 端口号
- * @param handler 处理程序
- * @param server 当前主机是服务器吗？
+ * @param handler 处理程序，该端口上的所有连接共用
+ * @param server 是否监听，监听的端口接受对方发起的连接
  * @return int 成功为0，失败为-1
  */
 int tcp_open(uint16_t port, tcp_handler_t handler, int server) {
-  is_server = server;
-  return map_set(&tcp_table, &port, &handler);
+  tcp_port_t p = {.handler = handler, .server = server};
+  return map_set(&tcp_ports, &port, &p);
 }
 
 /**
  * @brief 查询 tcp 连接是否已经关闭
  *
- * @return 1表示已经关闭，0表示没有关闭
+ * @param src_port 本地端口
+ * @param dst_ip 对方ip地址
+ * @param dst_port 对方端口
+ * @return 1表示已经关闭（或处于 TIME_WAIT），0表示没有关闭
  */
-int tcp_is_closed() { return is_end; }
+int tcp_is_closed(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+  tcp_tcb_t *tcb = tcp_lookup(src_port, dst_ip, dst_port);
+  return !tcb || tcb->state == TCP_TIME_WAIT;
+}
 
 /**
- * @brief 关闭一个 tcp 端口
+ * @brief 关闭一个 tcp 连接，已放入发送缓冲区的数据发完后发送 FIN
  *
- * @param port 目标端口号
- * @param dst_ip 目标 ip 地址
+ * @param src_port 本地端口
+ * @param dst_ip 对方ip地址
+ * @param dst_port 对方端口
  */
-void tcp_close(uint16_t port, uint8_t *dst_ip) {
-  buf_t buf;
-  buf_init(&buf, 0);
-  tcp_out(&buf, 0, 60000, dst_ip, port, 0, 1, 1);
-  fin_send = true;
-  map_delete(&tcp_table, &port);
+void tcp_close(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+  tcp_tcb_t *tcb = tcp_lookup(src_port, dst_ip, dst_port);
+  if (tcb)
+    tcp_shutdown(tcb);
 }
 
+/**
+ * @brief 为连接选择拥塞控制算法，拥塞窗口从初始值重新开始
+ *
+ * @param src_port 本地端口
+ * @param dst_ip 对方ip地址
+ * @param dst_port 对方端口
+ * @param name 算法名称，如 reno、cubic、bbr
+ * @return int 成功为0，连接或算法不存在为-1
+ */
+int tcp_set_cc(uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port,
+               const char *name) {
+  tcp_tcb_t *tcb = tcp_lookup(src_port, dst_ip, dst_port);
+  const tcp_cc_ops_t *cc = tcp_cc_find(name);
+  if (!tcb || !cc) {
+    fprintf(stderr, "tcp_set_cc: no connection or unknown algorithm %s\n",
+            name);
+    return -1;
+  }
+  tcb->cc = cc;
+  cc->init(tcb);
+  return 0;
+}
+
+/**
+ * @brief 获取当前的连接数，包括正在建立和正在关闭的
+ *
+ * @return size_t 连接数
+ */
+size_t tcp_count() { return map_size(&tcp_table); }
+
 /**
  * @brief 初始化 tcp 协议
  *
  */
 void tcp_init() {
-  map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
+  map_init(&tcp_table, sizeof(tcp_key_t), sizeof(tcp_tcb_t *), 0, 0, NULL,
+           NULL);
+  map_init(&tcp_ports, sizeof(uint16_t), sizeof(tcp_port_t), 0, 0, NULL,
+           NULL);
   net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
-  queue_init(&outstream);
-  tcp_rst();
-}
\ No newline at end of file
+}
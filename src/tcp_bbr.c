@@ -0,0 +1,225 @@
+#include "tcp_cc.h"
+
+// xn: 基于模型的拥塞控制，按 BBR（v1）的思路简化实现。
+// 不把丢包当作拥塞信号，而是测量瓶颈带宽（最近10轮交付速率的最大值）和
+// 最小 RTT，按二者之积即 BDP 设置 cwnd，按带宽限速发送，使瓶颈队列保持很短。
+// 状态机：STARTUP 以2/ln2的增益指数探测带宽，连续3轮带宽增长不足25%则转入
+// DRAIN 排空多出的排队，之后在 PROBE_BW 中循环使用 1.25、0.75、1... 的增益；
+// 最小 RTT 超过10秒未更新时进入 PROBE_RTT，把在途数据减到4个报文段保持200毫秒。
+// 省略了应用受限的判断，交付速率在应用发送不足时会被低估
+
+#define BBR_BW_ROUNDS 10                // 带宽取最近这么多轮的最大值
+#define BBR_MIN_RTT_WIN_US 10000000     // 最小 RTT 的有效期
+#define BBR_PROBE_RTT_US 200000         // PROBE_RTT 保持的时间
+#define BBR_HIGH_GAIN 2.885             // 2/ln2，STARTUP 阶段每轮发送速率翻倍
+#define BBR_CYCLE_LEN 8                 // PROBE_BW 增益循环的长度
+#define BBR_MIN_CWND(tcb) (4 * (tcb)->snd_mss) // cwnd 下限
+
+typedef enum bbr_mode {
+  BBR_STARTUP,
+  BBR_DRAIN,
+  BBR_PROBE_BW,
+  BBR_PROBE_RTT,
+} bbr_mode_t;
+
+typedef struct bbr {
+  uint64_t bw[BBR_BW_ROUNDS];    // 各轮交付速率的最大值，字节/秒
+  uint64_t next_round_delivered; // delivered 达到此值时开始新的一轮
+  uint64_t full_bw;              // STARTUP 中最近一次明显增长后的带宽
+  uint64_t min_rtt_stamp_us;     // 最小 RTT 的测量时间
+  uint64_t cycle_stamp_us;       // 当前增益阶段开始的时间
+  uint64_t probe_rtt_done_us;    // PROBE_RTT 结束的时间，为0表示还在排空
+  uint32_t round;                // 已经过的轮数
+  uint32_t min_rtt_us;           // 最小 RTT
+  uint32_t prior_cwnd;           // 进入 PROBE_RTT 前的 cwnd
+  uint8_t full_bw_cnt;           // 带宽增长不足25%的连续轮数
+  uint8_t full_bw_reached;       // 已测得瓶颈带宽，STARTUP 结束
+  uint8_t cycle_idx;             // 当前增益阶段在循环中的位置
+  bbr_mode_t mode;
+  double pacing_gain;
+  double cwnd_gain;
+} bbr_t;
+
+_Static_assert(sizeof(bbr_t) <= TCP_CC_PRIV_SIZE * sizeof(uint64_t),
+               "bbr_t too large for cc_priv");
+
+static const double bbr_cycle_gain[BBR_CYCLE_LEN] = {1.25, 0.75, 1, 1,
+                                                     1,    1,    1, 1};
+
+/**
+ * @brief 内部函数，瓶颈带宽的估计值
+ *
+ * @param bbr 状态
+ * @return uint64_t 字节/秒，还没有测量值时为0
+ */
+static uint64_t bbr_max_bw(bbr_t *bbr) {
+  uint64_t bw = 0;
+  for (int i = 0; i < BBR_BW_ROUNDS; i++)
+    if (bbr->bw[i] > bw)
+      bw = bbr->bw[i];
+  return bw;
+}
+
+/**
+ * @brief 内部函数，按估计的带宽和最小 RTT 计算乘以增益后的 BDP
+ *
+ * @param tcb 连接
+ * @param gain 增益
+ * @return uint32_t 字节数，还没有测量值时为初始窗口
+ */
+static uint32_t bbr_bdp(tcp_tcb_t *tcb, double gain) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  uint64_t bw = bbr_max_bw(bbr);
+  if (bw == 0 || bbr->min_rtt_us == UINT32_MAX)
+    return tcp_cc_initial_cwnd(tcb);
+  return (uint32_t)(gain * bw * bbr->min_rtt_us / 1e6);
+}
+
+static void bbr_set_mode(bbr_t *bbr, bbr_mode_t mode) {
+  bbr->mode = mode;
+  switch (mode) {
+  case BBR_STARTUP:
+    bbr->pacing_gain = BBR_HIGH_GAIN;
+    bbr->cwnd_gain = BBR_HIGH_GAIN;
+    break;
+  case BBR_DRAIN:
+    bbr->pacing_gain = 1 / BBR_HIGH_GAIN;
+    bbr->cwnd_gain = BBR_HIGH_GAIN;
+    break;
+  case BBR_PROBE_BW:
+    bbr->pacing_gain = bbr_cycle_gain[bbr->cycle_idx];
+    bbr->cwnd_gain = 2;
+    break;
+  case BBR_PROBE_RTT:
+    bbr->pacing_gain = 1;
+    bbr->cwnd_gain = 1;
+    break;
+  }
+}
+
+static void bbr_init(tcp_tcb_t *tcb) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  memset(bbr, 0, sizeof(bbr_t));
+  bbr->min_rtt_us = UINT32_MAX;
+  bbr->min_rtt_stamp_us = net_clock_us();
+  bbr->next_round_delivered = tcb->delivered;
+  bbr_set_mode(bbr, BBR_STARTUP);
+  tcb->cwnd = tcp_cc_initial_cwnd(tcb);
+  tcb->ssthresh = UINT32_MAX;
+}
+
+static void bbr_on_rtt(tcp_tcb_t *tcb, uint32_t rtt_us) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  if (rtt_us <= bbr->min_rtt_us) {
+    bbr->min_rtt_us = rtt_us;
+    bbr->min_rtt_stamp_us = net_clock_us();
+  }
+}
+
+/**
+ * @brief 内部函数，推进状态机
+ *
+ * @param tcb 连接
+ * @param round_start 这个确认是否开始了新的一轮
+ */
+static void bbr_update_mode(tcp_tcb_t *tcb, int round_start) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  uint64_t now = net_clock_us();
+  uint64_t bw = bbr_max_bw(bbr);
+
+  if (round_start && !bbr->full_bw_reached) { // 带宽是否还在增长
+    if (bw >= bbr->full_bw * 5 / 4) {
+      bbr->full_bw = bw;
+      bbr->full_bw_cnt = 0;
+    } else if (++bbr->full_bw_cnt >= 3)
+      bbr->full_bw_reached = 1;
+  }
+  if (bbr->mode == BBR_STARTUP && bbr->full_bw_reached)
+    bbr_set_mode(bbr, BBR_DRAIN);
+  if (bbr->mode == BBR_DRAIN && tcp_cc_inflight(tcb) <= bbr_bdp(tcb, 1)) {
+    bbr->cycle_idx = 2; // 从增益为1的阶段开始，不紧接着排空再探测
+    bbr->cycle_stamp_us = now;
+    bbr_set_mode(bbr, BBR_PROBE_BW);
+  }
+  if (bbr->mode == BBR_PROBE_BW && bbr->min_rtt_us != UINT32_MAX &&
+      now - bbr->cycle_stamp_us > bbr->min_rtt_us) { // 每个阶段持续一个 RTT
+    bbr->cycle_idx = (bbr->cycle_idx + 1) % BBR_CYCLE_LEN;
+    bbr->cycle_stamp_us = now;
+    bbr_set_mode(bbr, BBR_PROBE_BW);
+  }
+
+  if (bbr->mode != BBR_PROBE_RTT &&
+      now - bbr->min_rtt_stamp_us > BBR_MIN_RTT_WIN_US) {
+    bbr->prior_cwnd = tcb->cwnd;
+    bbr->probe_rtt_done_us = 0;
+    bbr_set_mode(bbr, BBR_PROBE_RTT);
+  }
+  if (bbr->mode == BBR_PROBE_RTT) {
+    if (bbr->probe_rtt_done_us == 0 &&
+        tcp_cc_inflight(tcb) <= BBR_MIN_CWND(tcb))
+      bbr->probe_rtt_done_us = now + BBR_PROBE_RTT_US;
+    if (bbr->probe_rtt_done_us && now > bbr->probe_rtt_done_us) {
+      // 此时测得的 RTT 就是新的最小值
+      bbr->min_rtt_stamp_us = now;
+      if (tcb->cwnd < bbr->prior_cwnd)
+        tcb->cwnd = bbr->prior_cwnd;
+      bbr_set_mode(bbr, bbr->full_bw_reached ? BBR_PROBE_BW : BBR_STARTUP);
+      bbr->cycle_stamp_us = now;
+    }
+  }
+}
+
+static void bbr_on_ack(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  // 所确认的报文段发送之后才发出的数据都被确认时，一轮结束
+  int round_start = 0;
+  if (rs->prior_delivered >= bbr->next_round_delivered) {
+    bbr->next_round_delivered = tcb->delivered;
+    bbr->round++;
+    round_start = 1;
+    bbr->bw[bbr->round % BBR_BW_ROUNDS] = 0;
+  }
+  uint64_t *slot = &bbr->bw[bbr->round % BBR_BW_ROUNDS];
+  if (rs->delivery_rate > *slot)
+    *slot = rs->delivery_rate;
+
+  bbr_update_mode(tcb, round_start);
+
+  uint32_t target = bbr_bdp(tcb, bbr->cwnd_gain) + 3 * tcb->snd_mss;
+  if (bbr->full_bw_reached) {
+    tcb->cwnd += rs->acked;
+    if (tcb->cwnd > target)
+      tcb->cwnd = target;
+  } else if (tcb->cwnd < target || tcb->delivered < tcp_cc_initial_cwnd(tcb))
+    tcb->cwnd += rs->acked; // STARTUP 中只增不减
+  if (tcb->cwnd < BBR_MIN_CWND(tcb))
+    tcb->cwnd = BBR_MIN_CWND(tcb);
+  if (bbr->mode == BBR_PROBE_RTT && tcb->cwnd > BBR_MIN_CWND(tcb))
+    tcb->cwnd = BBR_MIN_CWND(tcb);
+}
+
+static void bbr_on_loss(tcp_tcb_t *tcb, int timeout) {
+  // 丢包不是拥塞信号，只有超时时才从一个报文段重新开始，之后随确认增长回来
+  if (timeout)
+    tcb->cwnd = tcb->snd_mss;
+}
+
+static uint64_t bbr_pacing_rate(tcp_tcb_t *tcb) {
+  bbr_t *bbr = (bbr_t *)tcb->cc_priv;
+  uint64_t bw = bbr_max_bw(bbr);
+  if (bw == 0) { // 还没有测量值，按初始窗口每个 RTT 发完估算
+    uint32_t rtt_us = tcb->srtt_us ? tcb->srtt_us : 1000;
+    bw = (uint64_t)tcb->cwnd * 1000000 / rtt_us;
+  }
+  // 略低于估计值，让瓶颈队列有机会排空
+  return (uint64_t)(bbr->pacing_gain * bw * 0.99);
+}
+
+const tcp_cc_ops_t tcp_cc_bbr = {
+    .name = "bbr",
+    .init = bbr_init,
+    .on_ack = bbr_on_ack,
+    .on_rtt = bbr_on_rtt,
+    .on_loss = bbr_on_loss,
+    .pacing_rate = bbr_pacing_rate,
+};
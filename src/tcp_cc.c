@@ -0,0 +1,107 @@
+#include "tcp_cc.h"
+
+// xn: 默认的 Reno 拥塞控制（RFC 5681），丢包恢复的部分即 NewReno（RFC 6582），
+// 由 tcp.c 实现。cwnd 以字节计，慢启动按确认的字节数增长（RFC 3465）
+
+typedef struct reno {
+  uint32_t acked; // 拥塞避免阶段累计确认的字节数，满一个 cwnd 就增加一个 MSS
+} reno_t;
+
+/**
+ * @brief 根据名称查找拥塞控制算法
+ *
+ * @param name 名称，如 reno、cubic、bbr
+ * @return const tcp_cc_ops_t* 算法，不存在为NULL
+ */
+const tcp_cc_ops_t *tcp_cc_find(const char *name) {
+  static const tcp_cc_ops_t *all[] = {&tcp_cc_reno, &tcp_cc_cubic,
+                                      &tcp_cc_bbr};
+  for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+    if (!strcmp(all[i]->name, name))
+      return all[i];
+  return NULL;
+}
+
+/**
+ * @brief 初始拥塞窗口，RFC 6928
+ *
+ * @param tcb 连接
+ * @return uint32_t 字节数
+ */
+uint32_t tcp_cc_initial_cwnd(tcp_tcb_t *tcb) {
+  uint32_t iw = 2 * tcb->snd_mss > 14600 ? 2 * tcb->snd_mss : 14600;
+  return 10 * tcb->snd_mss < iw ? 10 * tcb->snd_mss : iw;
+}
+
+/**
+ * @brief 在途的字节数，包括已视为丢失但还未被确认的
+ *
+ * @param tcb 连接
+ * @return uint32_t 字节数
+ */
+uint32_t tcp_cc_inflight(tcp_tcb_t *tcb) {
+  return tcb->snd_nxt - tcb->snd_una;
+}
+
+/**
+ * @brief 判断发送是否受拥塞窗口限制。不受限时不应增大窗口，
+ * 否则窗口会在应用或接收窗口限速期间无限增长（RFC 7661）
+ *
+ * @param tcb 连接
+ * @param rs 测量值
+ * @return int 受限为1
+ */
+int tcp_cc_cwnd_limited(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs) {
+  return 2 * rs->prior_inflight >= tcb->cwnd;
+}
+
+/**
+ * @brief 慢启动，每个确认按确认的字节数增大窗口，最多两个 MSS（RFC 3465）
+ *
+ * @param tcb 连接
+ * @param acked 新确认的字节数
+ */
+void tcp_cc_slow_start(tcp_tcb_t *tcb, uint32_t acked) {
+  tcb->cwnd += acked < 2 * tcb->snd_mss ? acked : 2 * tcb->snd_mss;
+}
+
+static void reno_init(tcp_tcb_t *tcb) {
+  reno_t *ca = (reno_t *)tcb->cc_priv;
+  ca->acked = 0;
+  tcb->cwnd = tcp_cc_initial_cwnd(tcb);
+  tcb->ssthresh = UINT32_MAX;
+}
+
+static void reno_on_ack(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs) {
+  reno_t *ca = (reno_t *)tcb->cc_priv;
+  if (tcb->ca_state == TCP_CA_RECOVERY || !tcp_cc_cwnd_limited(tcb, rs))
+    return;
+  if (tcb->cwnd < tcb->ssthresh) {
+    tcp_cc_slow_start(tcb, rs->acked);
+    return;
+  }
+  ca->acked += rs->acked;
+  if (ca->acked >= tcb->cwnd) {
+    ca->acked -= tcb->cwnd;
+    tcb->cwnd += tcb->snd_mss;
+  }
+}
+
+static void reno_on_loss(tcp_tcb_t *tcb, int timeout) {
+  reno_t *ca = (reno_t *)tcb->cc_priv;
+  uint32_t half = tcp_cc_inflight(tcb) / 2;
+  tcb->ssthresh = half > 2 * tcb->snd_mss ? half : 2 * tcb->snd_mss;
+  tcb->cwnd = timeout ? tcb->snd_mss : tcb->ssthresh;
+  ca->acked = 0;
+}
+
+static uint64_t reno_pacing_rate(tcp_tcb_t *tcb) { return 0; }
+
+const tcp_cc_ops_t tcp_cc_reno = {
+    .name = "reno",
+    .init = reno_init,
+    .on_ack = reno_on_ack,
+    .on_rtt = NULL,
+    .on_loss = reno_on_loss,
+    .pacing_rate = reno_pacing_rate,
+};
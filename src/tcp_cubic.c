@@ -0,0 +1,109 @@
+#include "tcp_cc.h"
+
+// xn: CUBIC 拥塞控制（RFC 9438）。拥塞避免阶段的窗口是距上次丢包时间的三次函数：
+//   W(t) = C * (t - K)^3 + W_max
+// 丢包后先快速回到 W_max 附近，在其附近保持平稳，再加速探测更大的窗口，
+// 增长速度与 RTT 无关。窗口低于同样条件下 Reno 的估计值时按 Reno 增长。
+// 窗口在这里以报文段为单位计算，与 RFC 中的公式一致
+
+#define CUBIC_C 0.4    // 三次函数的系数
+#define CUBIC_BETA 0.7 // 丢包后窗口乘以的系数
+
+typedef struct cubic {
+  double w_max;      // 上次丢包时的窗口，报文段
+  double k;          // 从本轮开始到窗口回到 w_max 的时间，秒
+  double origin;     // 三次函数的中心点，报文段
+  double w_est;      // 同样条件下 Reno 的窗口估计值，报文段
+  uint64_t epoch_us; // 本轮拥塞避免开始的时间，为0表示尚未开始
+} cubic_t;
+
+/**
+ * @brief 内部函数，立方根，牛顿迭代，免得链接数学库
+ *
+ * @param x 非负数
+ * @return double 立方根
+ */
+static double cubic_cbrt(double x) {
+  if (x <= 0)
+    return 0;
+  double y = x > 1 ? x / 3 : 1;
+  for (int i = 0; i < 50; i++) {
+    double next = (2 * y + x / (y * y)) / 3;
+    if (next >= y - 1e-9 && next <= y + 1e-9)
+      return next;
+    y = next;
+  }
+  return y;
+}
+
+static void cubic_init(tcp_tcb_t *tcb) {
+  cubic_t *ca = (cubic_t *)tcb->cc_priv;
+  memset(ca, 0, sizeof(cubic_t));
+  tcb->cwnd = tcp_cc_initial_cwnd(tcb);
+  tcb->ssthresh = UINT32_MAX;
+}
+
+static void cubic_on_ack(tcp_tcb_t *tcb, const tcp_rate_sample_t *rs) {
+  cubic_t *ca = (cubic_t *)tcb->cc_priv;
+  if (tcb->ca_state == TCP_CA_RECOVERY || !tcp_cc_cwnd_limited(tcb, rs))
+    return;
+  if (tcb->cwnd < tcb->ssthresh) {
+    tcp_cc_slow_start(tcb, rs->acked);
+    return;
+  }
+
+  double mss = tcb->snd_mss;
+  double w = tcb->cwnd / mss;
+  uint64_t now = net_clock_us();
+  if (ca->epoch_us == 0) {
+    ca->epoch_us = now;
+    if (w < ca->w_max) {
+      ca->k = cubic_cbrt((ca->w_max - w) / CUBIC_C);
+      ca->origin = ca->w_max;
+    } else {
+      ca->k = 0;
+      ca->origin = w;
+    }
+    ca->w_est = w;
+  }
+
+  // 目标取一个 RTT 之后的值，且一个 RTT 内最多增长到1.5倍
+  double t = (now - ca->epoch_us + tcb->srtt_us) / 1e6;
+  double target = ca->origin + CUBIC_C * (t - ca->k) * (t - ca->k) * (t - ca->k);
+  if (target < w)
+    target = w;
+  if (target > 1.5 * w)
+    target = 1.5 * w;
+  double acked = rs->acked / mss;
+  ca->w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / w;
+  w += (target - w) * acked / w;
+  if (ca->w_est > w)
+    w = ca->w_est;
+  tcb->cwnd = (uint32_t)(w * mss);
+}
+
+static void cubic_on_loss(tcp_tcb_t *tcb, int timeout) {
+  cubic_t *ca = (cubic_t *)tcb->cc_priv;
+  // 受接收窗口限制时 cwnd 可能远大于实际在途的数据，按二者中小的计算
+  uint32_t cwnd = tcp_cc_inflight(tcb) < tcb->cwnd ? tcp_cc_inflight(tcb)
+                                                    : tcb->cwnd;
+  double w = (double)cwnd / tcb->snd_mss;
+  // 快速收敛：窗口没有回到上次的 w_max 就又丢包，说明有新的流加入，让出带宽
+  ca->w_max = w < ca->w_max ? w * (1 + CUBIC_BETA) / 2 : w;
+  ca->epoch_us = 0;
+  uint32_t ssthresh = (uint32_t)(cwnd * CUBIC_BETA);
+  tcb->ssthresh =
+      ssthresh > 2 * tcb->snd_mss ? ssthresh : 2 * tcb->snd_mss;
+  tcb->cwnd = timeout ? tcb->snd_mss : tcb->ssthresh;
+}
+
+static uint64_t cubic_pacing_rate(tcp_tcb_t *tcb) { return 0; }
+
+const tcp_cc_ops_t tcp_cc_cubic = {
+    .name = "cubic",
+    .init = cubic_init,
+    .on_ack = cubic_on_ack,
+    .on_rtt = NULL,
+    .on_loss = cubic_on_loss,
+    .pacing_rate = cubic_pacing_rate,
+};
@@ -0,0 +1,256 @@
+#include "tcp_opt.h"
+#include "tcp_cc.h"
+
+// xn: 时间戳（RFC 7323）以毫秒为单位，起点按连接错开。本端把对方最近一个
+// 按序报文段的时间戳记为 ts_recent 并回显，对方回显的时间戳则给出精确的 RTT。
+// 重传队列按报文段记录的发送时间精确到微秒，所以 RTT 优先从那里测量；
+// 被确认的报文段重传过时 Karn 算法不能测量，回显的时间戳却能说明确认的是
+// 哪一次发送，这时改用时间戳测量。时间戳同时用于 PAWS，丢弃序号回绕后
+// 迟到的旧报文段。协商后没带时间戳的报文段照常处理，与 Linux 相同
+
+/**
+ * @brief 新连接是否提议和接受 SACK，为0时丢包只按 NewReno 恢复，同 Linux 的
+ * net.ipv4.tcp_sack
+ *
+ */
+int tcp_sack = 1;
+
+/**
+ * @brief 新连接是否提议和接受时间戳，为0时不做 PAWS 检查，RTT 只按重传队列
+ * 测量，同 Linux 的 net.ipv4.tcp_timestamps
+ *
+ */
+int tcp_timestamps = 1;
+
+/**
+ * @brief 内部函数，本端使用的窗口扩大因子，使整个接收缓冲区都能被通告
+ *
+ * @return uint8_t 扩大因子
+ */
+static uint8_t tcp_opt_wscale_local() {
+  uint8_t shift = 0;
+  while (shift < TCP_WSCALE_MAX && (TCP_RCV_BUF_SIZE >> shift) > UINT16_MAX)
+    shift++;
+  return shift;
+}
+
+/**
+ * @brief 内部函数，本端当前的时间戳
+ *
+ * @param tcb 连接
+ * @return uint32_t 时间戳，毫秒
+ */
+static inline uint32_t tcp_opt_ts_now(tcp_tcb_t *tcb) {
+  return (uint32_t)(net_clock_us() / 1000) + tcb->ts_offset;
+}
+
+/**
+ * @brief 解析首部中的选项，不认识的选项按长度跳过
+ *
+ * @param hdr tcp首部
+ * @param head_len 首部长度，包括选项
+ * @param opts 出口参数
+ */
+void tcp_opt_parse(tcp_hdr_t *hdr, int head_len, tcp_opts_t *opts) {
+  uint8_t *p = (uint8_t *)(hdr + 1);
+  uint8_t *end = (uint8_t *)hdr + head_len;
+  memset(opts, 0, sizeof(tcp_opts_t));
+  while (p < end && *p != TCP_OPT_EOL) {
+    if (*p == TCP_OPT_NOP) {
+      p++;
+      continue;
+    }
+    if (end - p < 2 || p[1] < 2 || p[1] > end - p)
+      return; // 选项长度错误，忽略余下的部分
+    if (p[0] == TCP_OPT_MSS && p[1] == 4)
+      opts->mss = (p[2] << 8) | p[3];
+    else if (p[0] == TCP_OPT_WSCALE && p[1] == 3) {
+      opts->wscale = p[2] > TCP_WSCALE_MAX ? TCP_WSCALE_MAX : p[2];
+      opts->has_wscale = 1;
+    } else if (p[0] == TCP_OPT_SACK_PERM && p[1] == 2)
+      opts->sack_ok = 1;
+    else if (p[0] == TCP_OPT_SACK && p[1] >= 10 && (p[1] - 2) % 8 == 0) {
+      for (int i = 0; i < (p[1] - 2) / 8 && i < TCP_SACK_MAX_BLOCKS; i++) {
+        uint32_t edge[2];
+        memcpy(edge, p + 2 + 8 * i, sizeof(edge));
+        opts->sack[i][0] = swap32(edge[0]);
+        opts->sack[i][1] = swap32(edge[1]);
+        opts->sack_cnt++;
+      }
+    } else if (p[0] == TCP_OPT_TS && p[1] == 10) {
+      uint32_t ts[2];
+      memcpy(ts, p + 2, sizeof(ts));
+      opts->tsval = swap32(ts[0]);
+      opts->tsecr = swap32(ts[1]);
+      opts->has_ts = 1;
+    }
+    p += p[1];
+  }
+}
+
+/**
+ * @brief 根据对方 SYN 中的选项确定报文段长度、窗口扩大因子，以及是否使用
+ * SACK 和时间戳
+ *
+ * @param tcb 连接
+ * @param opts 对方 SYN 中的选项
+ */
+void tcp_opt_syn_in(tcp_tcb_t *tcb, tcp_opts_t *opts) {
+  tcb->snd_mss = opts->mss ? opts->mss : TCP_MSS_DEFAULT;
+  if (tcb->snd_mss > TCP_MSS_LOCAL)
+    tcb->snd_mss = TCP_MSS_LOCAL;
+  tcb->wscale_ok = opts->has_wscale;
+  tcb->snd_wscale = opts->has_wscale ? opts->wscale : 0;
+  tcb->rcv_wscale = opts->has_wscale ? tcp_opt_wscale_local() : 0;
+  tcb->sack_ok = tcp_sack && opts->sack_ok;
+  tcb->ts_ok = tcp_timestamps && opts->has_ts;
+  if (tcb->ts_ok) {
+    tcb->ts_recent = opts->tsval;
+    tcb->last_ack_sent = tcb->rcv_nxt;
+    // 对方通告的 MSS 不含选项（RFC 6691），每个报文段都带的时间戳从中扣除
+    tcb->snd_mss -= TCP_OPT_TS_LEN;
+  }
+  tcb->cc->init(tcb); // 初始窗口取决于 MSS
+}
+
+/**
+ * @brief 内部函数，按乱序队列填写 SACK 选项。相接的数据段合成一块，
+ * 第一块包含最近收到的数据，其余按序号排列（RFC 2018 第4节）
+ *
+ * @param tcb 连接
+ * @param opt 出口参数，至少 room 字节
+ * @param room 选项可用的长度
+ * @return uint8_t 选项长度，没有乱序数据或放不下时为0
+ */
+static uint8_t tcp_opt_sack(tcp_tcb_t *tcb, uint8_t *opt, uint32_t room) {
+  uint32_t max = room < 12 ? 0 : (room - 4) / 8;
+  if (max > TCP_SACK_MAX_BLOCKS)
+    max = TCP_SACK_MAX_BLOCKS;
+  uint32_t blocks[TCP_SACK_MAX_BLOCKS][2];
+  uint32_t n = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint32_t i = 0; i < tcb->ooo_cnt && n < max;) {
+      uint32_t left = tcb->ooo[i].seq;
+      uint32_t right = left;
+      while (i < tcb->ooo_cnt && tcb->ooo[i].seq == right)
+        right += tcb->ooo[i++].buf.len;
+      int recent = TCP_SEQ_LEQ(left, tcb->sack_last) &&
+                   TCP_SEQ_LT(tcb->sack_last, right);
+      if (left != right && recent == (pass == 0)) {
+        blocks[n][0] = left;
+        blocks[n++][1] = right;
+      }
+    }
+  }
+  if (n == 0)
+    return 0;
+  uint8_t len = 0;
+  opt[len++] = TCP_OPT_NOP;
+  opt[len++] = TCP_OPT_NOP;
+  opt[len++] = TCP_OPT_SACK;
+  opt[len++] = 2 + 8 * n;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t edge[2] = {swap32(blocks[i][0]), swap32(blocks[i][1])};
+    memcpy(opt + len, edge, sizeof(edge));
+    len += sizeof(edge);
+  }
+  return len;
+}
+
+/**
+ * @brief 填写要发送的报文段的选项。SYN 带上 MSS 和协商中的各项扩展，
+ * 主动打开时总是提议，被动打开时只回应对方提议了的；之后的报文段按协商结果
+ * 带上时间戳，有乱序数据时再带上放得下的 SACK 块
+ *
+ * @param tcb 连接
+ * @param flags 报文段的标志位
+ * @param len 报文段的数据长度
+ * @param opt 出口参数，至少 TCP_OPT_MAX_LEN 字节
+ * @return uint8_t 选项长度
+ */
+uint8_t tcp_opt_build(tcp_tcb_t *tcb, uint8_t flags, uint32_t len,
+                      uint8_t *opt) {
+  uint8_t n = 0;
+  int propose = tcb->state == TCP_SYN_SENT;
+  if (flags & FLAG_SYN) {
+    opt[n++] = TCP_OPT_MSS;
+    opt[n++] = 4;
+    opt[n++] = TCP_MSS_LOCAL >> 8;
+    opt[n++] = TCP_MSS_LOCAL & 0xff;
+    if (propose || tcb->wscale_ok) {
+      opt[n++] = TCP_OPT_NOP;
+      opt[n++] = TCP_OPT_WSCALE;
+      opt[n++] = 3;
+      opt[n++] = tcp_opt_wscale_local();
+    }
+    if ((propose && tcp_sack) || tcb->sack_ok) {
+      opt[n++] = TCP_OPT_NOP;
+      opt[n++] = TCP_OPT_NOP;
+      opt[n++] = TCP_OPT_SACK_PERM;
+      opt[n++] = 2;
+    }
+  }
+  if ((propose && tcp_timestamps) || tcb->ts_ok) {
+    // 没有确认时回显的时间戳无效，填0（RFC 7323 第3.2节）
+    uint32_t ts[2] = {swap32(tcp_opt_ts_now(tcb)),
+                      swap32((flags & FLAG_ACK) ? tcb->ts_recent : 0)};
+    opt[n++] = TCP_OPT_NOP;
+    opt[n++] = TCP_OPT_NOP;
+    opt[n++] = TCP_OPT_TS;
+    opt[n++] = 10;
+    memcpy(opt + n, ts, sizeof(ts));
+    n += sizeof(ts);
+  }
+  if (!(flags & FLAG_SYN) && tcb->sack_ok && tcb->ooo_cnt) {
+    // 选项与数据合起来不超过对方的 MSS，snd_mss 已扣除了时间戳，
+    // 余下的空间给 SACK，放不下的块就不带了
+    uint32_t room = TCP_OPT_MAX_LEN - n;
+    if (len + room > tcb->snd_mss)
+      room = tcb->snd_mss - len;
+    n += tcp_opt_sack(tcb, opt + n, room);
+  }
+  return n;
+}
+
+/**
+ * @brief PAWS 检查：时间戳比 ts_recent 旧的报文段是序号回绕前迟到的，
+ * 不能接受（RFC 7323 第5.3节）
+ *
+ * @param tcb 连接
+ * @param opts 报文中的选项
+ * @return int 可以接受为1
+ */
+int tcp_opt_paws_ok(tcp_tcb_t *tcb, tcp_opts_t *opts) {
+  return !tcb->ts_ok || !opts->has_ts ||
+         TCP_SEQ_GEQ(opts->tsval, tcb->ts_recent);
+}
+
+/**
+ * @brief 记录要回显的时间戳。只记录不晚于上次确认位置的报文段，
+ * 回显的就是确认所针对的最早那个报文段的时间戳，延迟确认或乱序时
+ * 对方测得的 RTT 偏大而不会偏小（RFC 7323 第4.3节）
+ *
+ * @param tcb 连接
+ * @param opts 报文中的选项，已经过 PAWS 检查
+ * @param seq 报文段的序号
+ */
+void tcp_opt_ts_update(tcp_tcb_t *tcb, tcp_opts_t *opts, uint32_t seq) {
+  if (tcb->ts_ok && opts->has_ts && TCP_SEQ_LEQ(seq, tcb->last_ack_sent))
+    tcb->ts_recent = opts->tsval;
+}
+
+/**
+ * @brief 由对方回显的时间戳计算 RTT，精度为时间戳的1毫秒，不足1毫秒按1毫秒算
+ *
+ * @param tcb 连接
+ * @param opts 报文中的选项
+ * @return uint32_t 微秒，没有有效的回显时为0
+ */
+uint32_t tcp_opt_ts_rtt_us(tcp_tcb_t *tcb, tcp_opts_t *opts) {
+  if (!tcb->ts_ok || !opts->has_ts || opts->tsecr == 0)
+    return 0;
+  uint32_t rtt_ms = tcp_opt_ts_now(tcb) - opts->tsecr;
+  if (rtt_ms > TCP_RTO_MAX_MS)
+    return 0; // 回显的不是本端发出的时间戳
+  return (rtt_ms ? rtt_ms : 1) * 1000;
+}
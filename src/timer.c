@@ -0,0 +1,208 @@
+#include "timer.h"
+#include "utils.h"
+
+#define TIMER_ROOT_SIZE (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE (1 << TIMER_LEVEL_BITS)
+#define TIMER_ROOT_MASK (TIMER_ROOT_SIZE - 1)
+#define TIMER_LEVEL_MASK (TIMER_LEVEL_SIZE - 1)
+#define TIMER_LEVEL_SHIFT(n) (TIMER_ROOT_BITS + (n)*TIMER_LEVEL_BITS)
+
+/**
+ * @brief 分层时间轮，第0层每槽1毫秒，第n层每槽覆盖下一层转一圈的时间。
+ * 每个槽是以自身为哨兵的循环双向链表
+ *
+ */
+static net_timer_t timer_root[TIMER_ROOT_SIZE];
+static net_timer_t timer_level[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+static uint64_t timer_now = 0; // 时间轮当前处理到的毫秒
+static size_t timer_count = 0; // 已启动的定时器数量
+static int timer_ready = 0;
+
+/**
+ * @brief 内部函数，首次使用时初始化各槽的哨兵，并以当前时钟为起点
+ *
+ */
+static void timer_wheel_init() {
+  for (int i = 0; i < TIMER_ROOT_SIZE; i++)
+    timer_root[i].next = timer_root[i].prev = &timer_root[i];
+  for (int n = 0; n < TIMER_LEVELS; n++)
+    for (int i = 0; i < TIMER_LEVEL_SIZE; i++)
+      timer_level[n][i].next = timer_level[n][i].prev = &timer_level[n][i];
+  timer_now = net_clock_ms();
+  timer_ready = 1;
+}
+
+/**
+ * @brief 内部函数，按到期时间把定时器挂到对应层的槽中
+ *
+ * @param timer 要挂入的定时器
+ */
+static void timer_enqueue(net_timer_t *timer) {
+  uint64_t expire = timer->expire;
+  uint64_t delta = expire - timer_now;
+  net_timer_t *head;
+  if ((int64_t)(expire - timer_now) < 0) { // 已到期，下一个tick处理
+    head = &timer_root[timer_now & TIMER_ROOT_MASK];
+  } else if (delta < TIMER_ROOT_SIZE) {
+    head = &timer_root[expire & TIMER_ROOT_MASK];
+  } else {
+    int n = 0;
+    while (n < TIMER_LEVELS - 1 && delta >= (1ULL << TIMER_LEVEL_SHIFT(n + 1)))
+      n++;
+    if (delta >= (1ULL << TIMER_LEVEL_SHIFT(TIMER_LEVELS))) // 超出范围则截断
+      expire = timer_now + (1ULL << TIMER_LEVEL_SHIFT(TIMER_LEVELS)) - 1;
+    head = &timer_level[n][(expire >> TIMER_LEVEL_SHIFT(n)) & TIMER_LEVEL_MASK];
+  }
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+/**
+ * @brief 内部函数，把定时器从所在的槽中摘下
+ *
+ * @param timer 要摘下的定时器
+ */
+static void timer_unlink(net_timer_t *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = timer->prev = NULL;
+}
+
+/**
+ * @brief 内部函数，把第n层的一个槽中的定时器重新分配到更低的层
+ *
+ * @param n 层号
+ * @param index 槽号
+ * @return int 槽号，为0表示上一层也需要分配
+ */
+static int timer_cascade(int n, int index) {
+  net_timer_t *head = &timer_level[n][index];
+  while (head->next != head) {
+    net_timer_t *timer = head->next;
+    timer_unlink(timer);
+    timer_enqueue(timer);
+  }
+  return index;
+}
+
+/**
+ * @brief 启动（或重新启动）一个定时器
+ *
+ * @param timer 要启动的定时器
+ * @param timeout_ms 从当前时钟起多少毫秒后到期
+ * @param handler 到期时的回调函数
+ * @param arg 回调函数使用的参数
+ */
+void timer_add(net_timer_t *timer, uint64_t timeout_ms,
+               timer_handler_t handler, void *arg) {
+  if (!timer_ready)
+    timer_wheel_init();
+  timer_del(timer);
+  timer->expire = net_clock_ms() + timeout_ms;
+  timer->handler = handler;
+  timer->arg = arg;
+  timer_enqueue(timer);
+  timer_count++;
+}
+
+/**
+ * @brief 停止一个定时器，未启动的定时器不做处理
+ *
+ * @param timer 要停止的定时器
+ */
+void timer_del(net_timer_t *timer) {
+  if (!timer_pending(timer))
+    return;
+  timer_unlink(timer);
+  timer_count--;
+}
+
+/**
+ * @brief 把定时器搬到新的内存位置，已启动的定时器在时间轮中的位置保持不变。
+ * 用于存放定时器的数组扩容时，src之后不再使用
+ *
+ * @param dst 新位置
+ * @param src 原位置
+ */
+void timer_move(net_timer_t *dst, net_timer_t *src) {
+  *dst = *src;
+  if (!timer_pending(dst))
+    return;
+  dst->prev->next = dst;
+  dst->next->prev = dst;
+}
+
+/**
+ * @brief 查询定时器是否已启动且尚未到期
+ *
+ * @param timer 要查询的定时器
+ * @return int 1为已启动，0为未启动
+ */
+int timer_pending(net_timer_t *timer) { return timer->prev != NULL; }
+
+/**
+ * @brief 推进时间轮到给定时间，调用所有到期定时器的回调函数，由net_poll调用
+ *
+ * @param now_ms 当前的单调毫秒时钟
+ * @return int 到期的定时器数量
+ */
+int timer_run(uint64_t now_ms) {
+  int fired = 0;
+  if (!timer_ready)
+    timer_wheel_init();
+  while ((int64_t)(now_ms - timer_now) >= 0) {
+    if (timer_count == 0) { // 没有定时器时直接跳到当前时间
+      timer_now = now_ms + 1;
+      break;
+    }
+    int index = timer_now & TIMER_ROOT_MASK;
+    for (int n = 0; !index && n < TIMER_LEVELS; n++)
+      index = timer_cascade(n, (timer_now >> TIMER_LEVEL_SHIFT(n)) &
+                                   TIMER_LEVEL_MASK);
+    index = timer_now & TIMER_ROOT_MASK;
+
+    // 先摘下整个槽再逐个回调，回调中重新启动的定时器会挂入之后的槽
+    net_timer_t list;
+    net_timer_t *head = &timer_root[index];
+    timer_now++;
+    if (head->next == head)
+      continue;
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = list.prev->next = &list;
+    head->next = head->prev = head;
+    while (list.next != &list) {
+      net_timer_t *timer = list.next;
+      timer_unlink(timer);
+      timer_count--;
+      fired++;
+      timer->handler(timer);
+    }
+  }
+  return fired;
+}
+
+/**
+ * @brief 查询距下一次需要推进时间轮还有多少毫秒，供事件循环决定阻塞多久。
+ * 只查看第0层，上层的定时器在第0层转完一圈、向下分配时才会到期，
+ * 所以最多返回到下一次分配的时间，届时再重新计算
+ *
+ * @param now_ms 当前的单调毫秒时钟
+ * @return int64_t 毫秒数，没有已启动的定时器时为-1
+ */
+int64_t timer_next(uint64_t now_ms) {
+  if (!timer_ready || timer_count == 0)
+    return -1;
+  uint64_t t = timer_now;
+  if (t & TIMER_ROOT_MASK) {
+    while (timer_root[t & TIMER_ROOT_MASK].next ==
+           &timer_root[t & TIMER_ROOT_MASK]) {
+      t++;
+      if ((t & TIMER_ROOT_MASK) == 0)
+        break; // 需要从上层向下分配
+    }
+  }
+  return (int64_t)(t - now_ms) > 0 ? (int64_t)(t - now_ms) : 0;
+}
@@ -17,24 +17,10 @@ map_t udp_table;
  * @return uint16_t 伪校验和
  */
 static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip) {
-  uint16_t length = buf->len;
-
-  buf_add_header(buf, sizeof(udp_peso_hdr_t));
-  udp_peso_hdr_t ip_hdr;
-  memcpy(&ip_hdr, buf->data, sizeof(udp_peso_hdr_t));
-
-  udp_peso_hdr_t *peso_hdr = (udp_peso_hdr_t *)buf->data;
-  memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN * sizeof(uint8_t));
-  memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN * sizeof(uint8_t));
-  peso_hdr->placeholder = 0;
-  peso_hdr->protocol = NET_PROTOCOL_UDP;
-  peso_hdr->total_len16 = swap16(length);
-
-  //应该可以用之前写的那个checksum吧
-  uint16_t res = checksum16((uint16_t *)(buf->data), buf->len);
-  memcpy(buf->data, &ip_hdr, sizeof(udp_peso_hdr_t));
-  buf_remove_header(buf, sizeof(udp_peso_hdr_t));
-  return res;
+  // 伪首部直接按字段累加，不在buf的头部预留区中构造
+  uint32_t sum =
+      checksum_pseudo(src_ip, dst_ip, NET_PROTOCOL_UDP, buf->len, 0);
+  return swap16(checksum_fold(checksum_partial(buf->data, buf->len, sum)));
 }
 
 /**
@@ -50,20 +36,24 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
 
   udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
 
-  if (buf->len < swap16(hdr->total_len16)) {
+  uint16_t total_len = swap16(hdr->total_len16);
+  if (buf->len < total_len || total_len < sizeof(udp_hdr_t)) {
     return;
   }
+  buf_remove_padding(buf, buf->len - total_len);
 
+  // xn: 之前分片大报文的校验和总是不对，原因是checksum16用uint8_t存字数，
+  // 超过510字节就被截断了。校验和为0表示发送方没有计算，不做校验
   uint16_t checksum16_old = hdr->checksum16;
-  hdr->checksum16 = 0;
-  uint16_t checksum16_new = swap16(udp_checksum(buf, src_ip, net_if_ip));
-  if (0 != memcmp(&checksum16_old, &checksum16_new, sizeof(uint16_t))) {
-    // 不知道为什么当报文长度大到需要进行 ip 分片时（短报文没问题），我的
-    // checksum 怎么写都不对…… 所以我干脆直接不使用 checksum 了（反正 UDP
-    // 也没有要求可靠（）） 同理下面 udp_out 的时候也通过把 checksum 设为0来禁用
-    // return;
+  if (checksum16_old) {
+    hdr->checksum16 = 0;
+    uint16_t checksum16_new = swap16(udp_checksum(buf, src_ip, net_if_ip));
+    hdr->checksum16 = checksum16_old;
+    if (checksum16_new == 0)
+      checksum16_new = 0xffff;
+    if (checksum16_new != checksum16_old)
+      return;
   }
-  hdr->checksum16 = checksum16_old;
 
   uint16_t dst_port16 = swap16(hdr->dst_port16);
   uint16_t src_port16 = swap16(hdr->src_port16);
@@ -79,15 +69,16 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
 }
 
 /**
- * @brief 处理一个要发送的数据包
+ * @brief 内部函数，加上udp首部并发送，数据部分的校验和已经算好
  *
  * @param buf 要处理的包
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
+ * @param sum 数据部分的校验和部分和
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip,
-             uint16_t dst_port) {
+static void udp_out_sum(buf_t *buf, uint16_t src_port, uint8_t *dst_ip,
+                        uint16_t dst_port, uint32_t sum) {
   buf_add_header(buf, sizeof(udp_hdr_t));
   udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
   hdr->src_port16 = swap16(src_port);
@@ -95,19 +86,36 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip,
   // 总长度不包括伪头部和填充字节
   hdr->total_len16 = swap16(buf->len);
   hdr->checksum16 = 0;
-
-  // 禁用 checksum
-  // hdr->checksum16 = swap16(udp_checksum(buf, net_if_ip, dst_ip));
+  sum = checksum_partial(hdr, sizeof(udp_hdr_t), sum);
+  sum = checksum_pseudo(net_if_ip, dst_ip, NET_PROTOCOL_UDP, buf->len, sum);
+  hdr->checksum16 = checksum_fold(sum);
+  if (hdr->checksum16 == 0) // 0表示未计算校验和，计算结果为0时用全1代替
+    hdr->checksum16 = 0xffff;
 
   ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
 }
 
+/**
+ * @brief 处理一个要发送的数据包
+ *
+ * @param buf 要处理的包
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ */
+void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip,
+             uint16_t dst_port) {
+  udp_out_sum(buf, src_port, dst_ip, dst_port,
+              checksum_partial(buf->data, buf->len, 0));
+}
+
 /**
  * @brief 初始化udp协议
  *
  */
 void udp_init() {
-  map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL);
+  map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL,
+           NULL);
   net_add_protocol(NET_PROTOCOL_UDP, udp_in);
 }
 
@@ -140,8 +148,11 @@ void udp_close(uint16_t port) { map_delete(&udp_table, &port); }
  */
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip,
               uint16_t dst_port) {
-  buf_t buf;
-  buf_init(&buf, len);
-  memcpy(buf.data, data, len);
-  udp_out(&buf, src_port, dst_ip, dst_port);
+  buf_t buf = {0};
+  if (buf_init(&buf, len) < 0)
+    return;
+  // 拷贝数据的同时累加校验和，不必再遍历一遍
+  uint32_t sum = checksum_copy(buf.data, data, len, 0);
+  udp_out_sum(&buf, src_port, dst_ip, dst_port, sum);
+  buf_free(&buf);
 }
\ No newline at end of file
@@ -41,6 +41,60 @@ char *timetos(time_t timestamp) {
   return output;
 }
 
+/**
+ * @brief 协议栈时钟的缓存值，每轮net_poll更新一次，避免每次比较都调用time
+ *
+ */
+static time_t clock_sec = 0;
+static uint64_t clock_ms = 0;
+static uint64_t clock_us = 0;
+
+/**
+ * @brief 更新协议栈时钟，由net_poll在每轮轮询开始时调用
+ *
+ */
+void net_clock_update() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  clock_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  clock_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  clock_sec = time(NULL);
+}
+
+/**
+ * @brief 获取协议栈的秒级时钟（墙上时间），首次使用时初始化。
+ * 没有net_poll驱动时（如测试回放）时钟保持不变，超时判断因此是确定的
+ *
+ * @return time_t 最近一次更新时的时间戳
+ */
+time_t net_clock() {
+  if (!clock_sec)
+    net_clock_update();
+  return clock_sec;
+}
+
+/**
+ * @brief 获取协议栈的单调毫秒时钟，首次使用时初始化
+ *
+ * @return uint64_t 最近一次更新时的单调毫秒数
+ */
+uint64_t net_clock_ms() {
+  if (!clock_ms)
+    net_clock_update();
+  return clock_ms;
+}
+
+/**
+ * @brief 获取协议栈的单调微秒时钟，首次使用时初始化，用于忙轮询窗口的计时
+ *
+ * @return uint64_t 最近一次更新时的单调微秒数
+ */
+uint64_t net_clock_us() {
+  if (!clock_us)
+    net_clock_update();
+  return clock_us;
+}
+
 /**
  * @brief ip前缀匹配
  *
@@ -60,36 +114,4 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb) {
     }
   }
   return count;
-}
-
-/**
- * @brief 计算16位校验和
- *
- * @param buf 要计算的数据包
- * @param len 要计算的长度
- * @return uint16_t 校验和
- */
-uint16_t checksum16(uint16_t *buf, size_t len) {
-  uint8_t n = len / sizeof(uint16_t);
-  uint16_t data[n];
-  for (int i = 0; i < n; i++) {
-    memcpy(&data[i], buf + i, sizeof(uint16_t));
-  }
-
-  uint32_t add = 0;
-  if (n * sizeof(uint16_t) != len) {
-    uint8_t left = 0;
-    memcpy(&left, buf + n, sizeof(uint8_t));
-    add += left;
-  }
-
-  for (int i = 0; i < n; i++) {
-    add += data[i];
-  }
-
-  while (add >> 16) {
-    add = (add >> 16) + (add & 0xffff);
-  }
-
-  return swap16((uint16_t)(~add));
 }
\ No newline at end of file
@@ -58,6 +58,7 @@ int main(int argc, char* argv[]){
                         uint8_t * ip = buf.data + 30;
                         // net_protocol_t pro = buf.data[13] ? NET_PROTOCOL_ARP : NET_PROTOCOL_IP;
                         arp_out(&buf2, ip);
+                        buf_free(&buf2);
                 }else{
                         ethernet_in(&buf);
                 }
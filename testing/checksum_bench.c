@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "checksum.h"
+#include "config.h"
+
+/* 原先checksum16的算法：逐个16位字累加到32位，作为正确性参照和性能基线 */
+static uint32_t checksum_partial_legacy(const void *data, size_t len, uint32_t sum)
+{
+        const uint8_t *p = data;
+        uint64_t add = sum;
+        for (size_t i = 0; i + 1 < len; i += 2){
+                uint16_t w;
+                memcpy(&w, p + i, sizeof(uint16_t));
+                add += w;
+        }
+        if (len & 1){
+                uint16_t w = 0;
+                memcpy(&w, p + len - 1, sizeof(uint8_t));
+                add += w;
+        }
+        while (add >> 32)
+                add = (add & 0xffffffff) + (add >> 32);
+        return (uint32_t)add;
+}
+
+static double now_sec()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t data[BUF_MAX_LEN + 64];
+static uint8_t copy[BUF_MAX_LEN + 64];
+
+int main(int argc, char* argv[])
+{
+        const checksum_impl_t *impls;
+        size_t n = checksum_impl_list(&impls);
+        srand(1);
+        for (size_t i = 0; i < sizeof(data); i++)
+                data[i] = rand();
+
+        /* 所有实现在各种长度和对齐下都应与参照结果相同 */
+        size_t lens[] = {0, 1, 2, 3, 15, 16, 17, 31, 63, 64, 65, 127, 511, 512,
+                         513, 1500, 1501, 4097, 65535, BUF_MAX_LEN};
+        for (size_t i = 0; i < n; i++){
+                for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++){
+                        for (size_t off = 0; off < 4; off++){
+                                uint16_t expect = checksum_fold(checksum_partial_legacy(data + off, lens[l], 0));
+                                uint16_t got = checksum_fold(impls[i].partial(data + off, lens[l], 0));
+                                memset(copy, 0, lens[l]);
+                                uint16_t copied = checksum_fold(impls[i].copy(copy, data + off, lens[l], 0));
+                                if (copied != expect || memcmp(copy, data + off, lens[l])){
+                                        printf("\e[1;31m%s copy: len %zu offset %zu: %04x != %04x\n\e[0m",
+                                                impls[i].name, lens[l], off, copied, expect);
+                                        return -1;
+                                }
+                                if (expect != got){
+                                        printf("\e[1;31m%s: len %zu offset %zu: %04x != %04x\n\e[0m",
+                                                impls[i].name, lens[l], off, got, expect);
+                                        return -1;
+                                }
+                        }
+                }
+        }
+        printf("\e[1;32mAll %zu checksum implementations agree.\n\e[0m", n);
+
+        /* 增量更新的结果应与重新计算的相同 */
+        for (int r = 0; r < 100000; r++){
+                uint8_t pkt[64];
+                for (size_t i = 0; i < sizeof(pkt); i++)
+                        pkt[i] = rand();
+                size_t at = (rand() % (sizeof(pkt) / 4)) * 4;
+                uint16_t check = checksum_fold(checksum_partial(pkt, sizeof(pkt), 0));
+                uint32_t from, to = rand();
+                memcpy(&from, pkt + at, sizeof(uint32_t));
+                memcpy(pkt + at, &to, sizeof(uint32_t));
+                uint16_t expect = checksum_fold(checksum_partial(pkt, sizeof(pkt), 0));
+                uint16_t got = (r & 1) ? checksum_update32(check, from, to)
+                        : checksum_update16(checksum_update16(check, from, to), from >> 16, to >> 16);
+                if (expect != got){
+                        printf("\e[1;31mchecksum_update: %04x != %04x\n\e[0m", got, expect);
+                        return -1;
+                }
+        }
+
+        /* 默认只做正确性检查，参数为bench时测量吞吐量 */
+        if (argc < 2 || strcmp(argv[1], "bench"))
+                return 0;
+        size_t sizes[] = {64, 576, 1500, 9000, 65535};
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+                size_t rounds = (64 << 20) / sizes[s];
+                double t0 = now_sec();
+                volatile uint32_t sink = 0;
+                for (size_t r = 0; r < rounds; r++)
+                        sink += checksum_partial_legacy(data, sizes[s], 0);
+                double base = now_sec() - t0;
+                printf("%6zu bytes  %-7s %8.2f MB/s\n", sizes[s], "legacy",
+                        rounds * sizes[s] / base / 1e6);
+                for (size_t i = 0; i < n; i++){
+                        t0 = now_sec();
+                        for (size_t r = 0; r < rounds; r++)
+                                sink += impls[i].partial(data, sizes[s], 0);
+                        double t = now_sec() - t0;
+                        printf("%6zu bytes  %-7s %8.2f MB/s  x%.2f\n", sizes[s], impls[i].name,
+                                rounds * sizes[s] / t / 1e6, base / t);
+                }
+                /* 发送路径：先memcpy再累加，与拷贝时同时累加比较 */
+                const checksum_impl_t *best = &impls[n - 1];
+                t0 = now_sec();
+                for (size_t r = 0; r < rounds; r++){
+                        memcpy(copy, data, sizes[s]);
+                        sink += best->partial(copy, sizes[s], 0);
+                }
+                double two_pass = now_sec() - t0;
+                t0 = now_sec();
+                for (size_t r = 0; r < rounds; r++)
+                        sink += best->copy(copy, data, sizes[s], 0);
+                double fused = now_sec() - t0;
+                printf("%6zu bytes  memcpy+%-5s %8.2f MB/s, fused %8.2f MB/s  x%.2f\n", sizes[s],
+                        best->name, rounds * sizes[s] / two_pass / 1e6,
+                        rounds * sizes[s] / fused / 1e6, two_pass / fused);
+        }
+        return 0;
+}
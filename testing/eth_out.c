@@ -43,6 +43,7 @@ int main(int argc, char* argv[]){
                 proto <<= 8;
                 proto |= buf2.data[13];
                 ethernet_out(&buf,buf2.data,proto);
+                buf_free(&buf2);
         }
         if(ret < 0){
                 fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
@@ -77,6 +77,14 @@ int driver_recv(buf_t *buf)
         }
 }
 
+int driver_recv_burst(buf_t *bufs, int n)
+{
+        int cnt = 0;
+        while(cnt < n && driver_recv(&bufs[cnt]) > 0)
+                cnt++;
+        return cnt;
+}
+
 int driver_send(buf_t *buf)
 {
         struct pcap_pkthdr header;
@@ -87,6 +95,21 @@ int driver_send(buf_t *buf)
         return 0;
 }
 
+int driver_flush()
+{
+        return 0;
+}
+
+int driver_tx_poll()
+{
+        return 0;
+}
+
+int driver_fd()
+{
+        return -1;
+}
+
 void driver_close()
 {
         fprintf(control_flow,"\ndriver closed\n");
@@ -136,7 +136,7 @@ void fprint_buf(FILE* f, buf_t* buf)
 
 static inline void *map_entry_get(map_t *map, size_t pos)
 {
-        if (pos >= map->max_size)
+        if (pos >= map->used)
                 return NULL;
         return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
 }
@@ -144,12 +144,12 @@ static inline void *map_entry_get(map_t *map, size_t pos)
 static inline int map_entry_valid(map_t *map, const void *entry)
 {
         time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-        return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+        return entry_time && (!map->timeout || entry_time + map->timeout >= net_clock());
 }
 
 void log_tab_buf(){
         fprintf(arp_log_f, "<====== arp table =======>\n");
-        for (size_t i = 0; i < arp_table.max_size; i++)
+        for (size_t i = 0; i < arp_table.used; i++)
         {
                 uint8_t *entry = (uint8_t*) map_entry_get(&arp_table, i);
                 if (map_entry_valid(&arp_table, entry))
@@ -159,16 +159,19 @@ void log_tab_buf(){
         }
 
         fprintf(arp_log_f, "<====== arp buf =======>\n");
-        for (size_t i = 0; i < arp_buf.max_size; i++)
+        for (size_t i = 0; i < arp_buf.used; i++)
         {
                 uint8_t *entry = (uint8_t*) map_entry_get(&arp_buf, i);
                 if (map_entry_valid(&arp_buf, entry)) {
-                        fprintf(arp_log_f, "%s -> ", print_ip(entry));
-                        buf_t * buf = (buf_t*) (entry + arp_buf.key_len);
-                        for(int i = 0; i < buf->len; i++){
-                                fprintf(arp_log_f," %02x",buf->data[i]);
+                        arp_pending_t * q = (arp_pending_t*) (entry + arp_buf.key_len);
+                        for(int j = 0; j < q->cnt; j++){
+                                buf_t * buf = &q->bufs[(q->head + j) % ARP_PENDING_MAX];
+                                fprintf(arp_log_f, "%s -> ", print_ip(entry));
+                                for(int i = 0; i < buf->len; i++){
+                                        fprintf(arp_log_f," %02x",buf->data[i]);
+                                }
+                                fputc('\n', arp_log_f);
                         }
-                        fputc('\n', arp_log_f);
                 }
         }
 }
@@ -21,17 +21,17 @@ int main(int argc, char* argv[])
                 return -1;
         }
         arp_fout = control_flow;
-        uint8_t * p = buf.payload + 1000;
-        buf.data = p;
-        buf.len = 0;
+        static uint8_t text[BUF_MAX_LEN];
+        size_t len = 0;
         char c;
         while(fread(&c,1,1,in)){
-                *p = c;
-                p++;
-                buf.len++;
+                text[len++] = c;
         }
+        buf_init(&buf, len);
+        memcpy(buf.data, text, len);
         printf("\e[0;34mFeeding input.\n");
         ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
+        buf_free(&buf);
 
         fclose(in);
         fclose(control_flow);
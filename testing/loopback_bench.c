@@ -0,0 +1,430 @@
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "icmp.h"
+#include "net.h"
+#include "tcp.h"
+#include "tcp_opt.h"
+#include "udp.h"
+
+/* 两个协议栈实例经回环驱动背靠背相连：子进程为对端，回显收到的udp数据报；
+ * 父进程发出请求并检查回显。默认只做正确性检查，参数为bench时测量吞吐量与时延，
+ * 其后可跟 loss=0.01 reorder=0.01 delay=1 指定两个方向的损伤；参数为tcp时
+ * 比较各拥塞控制算法，其后可跟 rate=100 queue=65536 模拟带宽受限的瓶颈。
+ * 参数为check时同样可跟损伤，有损伤时只检查多个连接同时批量传输的tcp回显，
+ * 再跟 cc=cubic conns=32 可指定这些连接的拥塞控制算法和个数，sack=0 ts=0
+ * 关闭 SACK 和时间戳。
+ * 子进程同时在TCP_PORT上监听tcp连接并回显，在SINK_PORT上接收并丢弃 */
+
+#define PORT 60000
+#define TCP_PORT 60001
+#define SINK_PORT 60002
+#define MAX_SEQ 4096
+#define TCP_CONNS 32
+#define TCP_LOSS_CONNS 8      /* 有损伤时默认同时传输的连接数 */
+#define TCP_LOSS_LEN 200000   /* 有损伤时每个连接传输的字节数，小于对端的发送缓冲区 */
+
+/* 两端都在忙轮询，单核机器上每轮让出CPU，对端才能及时处理 */
+static void poll_once()
+{
+        net_poll();
+        sched_yield();
+}
+
+static uint8_t peer_ip[NET_IP_LEN] = {10, 250, 196, 104};
+static uint8_t peer_mac[NET_MAC_LEN] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x56};
+static uint8_t payload[UINT16_MAX];
+
+static int replied[MAX_SEQ]; /* 0为等待回显，1为已回显，2为已视为丢失 */
+static int inflight;
+static size_t reply_cnt, reply_bytes, reply_bad, reply_reordered;
+static uint32_t last_seq;
+
+static double now_sec()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 数据报内容由序号决定，回显时可以逐字节检查 */
+static void fill(uint32_t seq, size_t len)
+{
+        for (size_t i = 0; i < len; i++)
+                payload[i] = (uint8_t)(seq * 31 + i);
+        if (len >= sizeof(seq))
+                memcpy(payload, &seq, sizeof(seq));
+}
+
+static void echo_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        udp_send(data, len, PORT, src_ip, src_port);
+}
+
+static void reply_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        uint32_t seq = 0;
+        if (len >= sizeof(seq))
+                memcpy(&seq, data, sizeof(seq));
+        for (size_t i = sizeof(seq); i < len; i++)
+                if (data[i] != (uint8_t)(seq * 31 + i)){
+                        reply_bad++;
+                        return;
+                }
+        if (reply_cnt && seq < last_seq)
+                reply_reordered++;
+        last_seq = seq;
+        if (replied[seq % MAX_SEQ] == 0)
+                inflight--;
+        replied[seq % MAX_SEQ] = 1;
+        reply_cnt++;
+        reply_bytes += len;
+}
+
+static void tcp_echo_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        tcp_send(data, len, TCP_PORT, src_ip, src_port);
+}
+
+/* 第c个连接的第k个字节：高5位为c，低3位由k散列而来。收到的字节可以按内容
+ * 归到各自的连接，并检查是否与发出的一致、按序且不重不漏 */
+static size_t tcp_received[TCP_CONNS];
+static size_t tcp_bad;
+
+static uint8_t tcp_pattern(int c, size_t k)
+{
+        return (uint8_t)(c << 3 | ((uint32_t)k * 2654435761u) >> 29);
+}
+
+static void tcp_reply_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        int c = data[0] >> 3;
+        for (size_t i = 0; i < len; i++)
+                if (data[i] != tcp_pattern(c, tcp_received[c] + i)){
+                        tcp_bad++;
+                        return;
+                }
+        tcp_received[c] += len;
+}
+
+static void sink_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+}
+
+static pid_t spawn_peer(const driver_loopback_impair_t *impair)
+{
+        pid_t pid = fork();
+        if (pid)
+                return pid;
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        memcpy(net_if_ip, peer_ip, NET_IP_LEN);
+        memcpy(net_if_mac, peer_mac, NET_MAC_LEN);
+        driver_loopback_side(1, impair);
+        if (net_init() == -1)
+                exit(-1);
+        udp_open(PORT, echo_handler);
+        tcp_open(TCP_PORT, tcp_echo_handler, 1);
+        tcp_open(SINK_PORT, sink_handler, 1);
+        while (1)
+                poll_once();
+}
+
+/* 发出一个数据报并等待回显，超时返回-1 */
+static int echo_once(uint32_t seq, size_t len, double timeout)
+{
+        fill(seq, len);
+        replied[seq % MAX_SEQ] = 0;
+        udp_send(payload, len, PORT, peer_ip, PORT);
+        double t0 = now_sec();
+        while (!replied[seq % MAX_SEQ]){
+                poll_once();
+                if (now_sec() - t0 > timeout)
+                        return -1;
+        }
+        return 0;
+}
+
+/* 在网络中始终保持window个未回显的数据报，持续duration秒，超过0.1秒未回显的视为丢失 */
+static void stream(size_t len, int window, double duration, size_t *sent)
+{
+        static double sent_at[MAX_SEQ];
+        uint32_t seq = 0, oldest = 0;
+        double t0 = now_sec(), now;
+        inflight = 0;
+        while ((now = now_sec()) - t0 < duration){
+                for (; oldest < seq; oldest++){
+                        if (replied[oldest % MAX_SEQ] == 0 && now - sent_at[oldest % MAX_SEQ] <= 0.1)
+                                break;
+                        if (replied[oldest % MAX_SEQ] == 0){
+                                replied[oldest % MAX_SEQ] = 2;
+                                inflight--;
+                        }
+                }
+                while (inflight < window && seq - oldest < MAX_SEQ){
+                        inflight++;
+                        fill(seq, len);
+                        replied[seq % MAX_SEQ] = 0;
+                        sent_at[seq % MAX_SEQ] = now;
+                        udp_send(payload, len, PORT, peer_ip, PORT);
+                        seq++;
+                }
+                poll_once();
+        }
+        *sent = seq;
+        t0 = now_sec();
+        while (now_sec() - t0 < 0.1)
+                poll_once();
+}
+
+/* 同时建立conns个连接，各自发送len字节并等待回显，再全部关闭，
+ * cc为拥塞控制算法，NULL为默认 */
+static int tcp_echo(int conns, size_t len, double timeout, const char *cc)
+{
+        memset(tcp_received, 0, sizeof(tcp_received));
+        for (int i = 0; i < conns; i++){
+                tcp_open(PORT + 100 + i, tcp_reply_handler, 0);
+                if (tcp_connect(PORT + 100 + i, peer_ip, TCP_PORT) < 0)
+                        return -1;
+                if (cc && tcp_set_cc(PORT + 100 + i, peer_ip, TCP_PORT, cc) < 0)
+                        return -1;
+        }
+        /* 数据先进入发送缓冲区，连接建立后自动发出 */
+        for (int i = 0; i < conns; i++){
+                for (size_t off = 0; off < len; off += UINT16_MAX){
+                        size_t n = len - off < UINT16_MAX ? len - off : UINT16_MAX;
+                        for (size_t k = 0; k < n; k++)
+                                payload[k] = tcp_pattern(i, off + k);
+                        if (tcp_send(payload, n, PORT + 100 + i, peer_ip, TCP_PORT) != (int)n)
+                                return -1;
+                }
+        }
+        double t0 = now_sec();
+        for (int i = 0; i < conns; i++)
+                while (tcp_received[i] < len && !tcp_bad && now_sec() - t0 < timeout)
+                        poll_once();
+        for (int i = 0; i < conns; i++){
+                if (tcp_received[i] != len || tcp_bad)
+                        return -1;
+                tcp_close(PORT + 100 + i, peer_ip, TCP_PORT);
+        }
+        for (int i = 0; i < conns; i++)
+                while (!tcp_is_closed(PORT + 100 + i, peer_ip, TCP_PORT))
+                        if (now_sec() - t0 > timeout)
+                                return -1;
+                        else
+                                poll_once();
+        return 0;
+}
+
+static int check()
+{
+        /* 首个请求同时触发arp解析 */
+        uint8_t data[32] = {0};
+        int seq = icmp_send_echo_request(data, sizeof(data), peer_ip);
+        double t0 = now_sec();
+        while (icmp_wait_echo_reply(seq) == -1 && now_sec() - t0 < 2)
+                poll_once();
+        if (icmp_wait_echo_reply(seq) == -1){
+                printf("\e[1;31mping timed out\n\e[0m");
+                return -1;
+        }
+
+        /* 各种长度，包括需要分片的，最多IP_MAX_FRAGMENT个分片 */
+        size_t lens[] = {4, 64, 1472, 1473, 3000, 8000, 14000};
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++){
+                if (echo_once(l + 1, lens[l], 2) < 0 || reply_bad){
+                        printf("\e[1;31mudp echo of %zu bytes failed\n\e[0m", lens[l]);
+                        return -1;
+                }
+        }
+
+        /* 批量发送，不应有任何丢失 */
+        size_t sent;
+        reply_cnt = reply_reordered = 0;
+        stream(1000, 256, 0.2, &sent);
+        if (reply_cnt != sent || reply_bad || reply_reordered){
+                printf("\e[1;31mudp stream: %zu of %zu echoed, %zu bad, %zu reordered\n\e[0m",
+                        reply_cnt, sent, reply_bad, reply_reordered);
+                return -1;
+        }
+
+        if (tcp_echo(TCP_CONNS, 3000, 5, NULL) < 0){
+                printf("\e[1;31mtcp echo over %d connections failed, %zu bad segments\n\e[0m",
+                        TCP_CONNS, tcp_bad);
+                return -1;
+        }
+        printf("\e[1;32mLoopback echo passed (%zu datagrams, %d tcp connections).\n\e[0m",
+                sent, TCP_CONNS);
+        return 0;
+}
+
+/* 有损伤时只检查tcp：多个连接同时批量传输，丢失和乱序的报文段须由重传和
+ * 重组修复，回显的数据与发出的完全一致且按序，丢包恢复确实被触发。
+ * cc为拥塞控制算法，NULL为默认；conns为连接数，不超过TCP_CONNS */
+static int check_impaired(const char *cc, int conns)
+{
+        if (conns < 1 || conns > TCP_CONNS){
+                printf("\e[1;31mconns must be between 1 and %d\n\e[0m", TCP_CONNS);
+                return -1;
+        }
+        if (tcp_echo(conns, TCP_LOSS_LEN, 60, cc) < 0){
+                printf("\e[1;31mtcp echo over %d lossy connections (%s) failed, %zu bad segments\n\e[0m",
+                        conns, cc ? cc : TCP_CC_DEFAULT, tcp_bad);
+                for (int i = 0; i < conns; i++)
+                        printf("connection %d: %zu of %d bytes echoed\n", i, tcp_received[i], TCP_LOSS_LEN);
+                return -1;
+        }
+        if (driver_loopback_stats.lost && tcp_stats.fast_retransmits == 0){
+                printf("\e[1;31mframes were lost but no fast retransmit happened\n\e[0m");
+                return -1;
+        }
+        /* 允许 SACK 时空缺须按记分板重传，关闭时不能有按记分板的重传 */
+        if (driver_loopback_stats.lost && !tcp_stats.sack_retransmits != !tcp_sack){
+                printf("\e[1;31mSACK %s but %lu retransmits followed the scoreboard\n\e[0m",
+                        tcp_sack ? "enabled" : "disabled", tcp_stats.sack_retransmits);
+                return -1;
+        }
+        printf("\e[1;32mLossy tcp echo passed (%s, %d connections, %d bytes each, "
+               "%lu frames lost, %lu reordered, retransmits fast %lu partial ack %lu "
+               "sack %lu timeout %lu ooo drops %lu).\n\e[0m",
+                cc ? cc : TCP_CC_DEFAULT, conns, TCP_LOSS_LEN, driver_loopback_stats.lost,
+                driver_loopback_stats.reordered, tcp_stats.fast_retransmits,
+                tcp_stats.partial_retransmits, tcp_stats.sack_retransmits,
+                tcp_stats.timeout_retransmits, tcp_stats.ooo_drops);
+        return 0;
+}
+
+/* 经一个连接向对端发送total字节，返回直到全部被确认、连接关闭所用的秒数，
+ * cc为拥塞控制算法，NULL为默认 */
+static double tcp_bulk(size_t total, double timeout, const char *cc)
+{
+        static uint16_t port = PORT + 1000;
+        port++;
+        tcp_open(port, NULL, 0);
+        tcp_connect(port, peer_ip, SINK_PORT);
+        if (cc && tcp_set_cc(port, peer_ip, SINK_PORT, cc) < 0)
+                return -1;
+        double t0 = now_sec();
+        size_t sent = 0;
+        while (sent < total && now_sec() - t0 < timeout){
+                size_t len = total - sent < UINT16_MAX ? total - sent : UINT16_MAX;
+                int n = tcp_send(payload, len, port, peer_ip, SINK_PORT);
+                if (n < 0)
+                        return -1;
+                sent += n;
+                poll_once();
+        }
+        tcp_close(port, peer_ip, SINK_PORT);
+        while (!tcp_is_closed(port, peer_ip, SINK_PORT) && now_sec() - t0 < timeout)
+                poll_once();
+        return tcp_is_closed(port, peer_ip, SINK_PORT) ? now_sec() - t0 : -1;
+}
+
+static void bench()
+{
+        size_t sent;
+        int rounds = 10000;
+        double t0 = now_sec();
+        for (int i = 0; i < rounds; i++)
+                if (echo_once(i, 64, 0.05) < 0)
+                        rounds--;
+        printf("udp 64 bytes ping-pong: %8.2f us rtt\n", (now_sec() - t0) / rounds * 1e6);
+
+        size_t lens[] = {64, 1472, 8000};
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++){
+                reply_cnt = reply_bytes = 0;
+                t0 = now_sec();
+                stream(lens[l], 64, 1, &sent);
+                double t = now_sec() - t0;
+                printf("udp %5zu bytes echo:  %10.0f pps %9.2f Mbit/s  %zu/%zu echoed\n",
+                        lens[l], reply_cnt / t, reply_bytes * 8 / t / 1e6, reply_cnt, sent);
+        }
+
+        size_t total = 256 << 20;
+        double t = tcp_bulk(total, 30, NULL);
+        if (t < 0)
+                printf("tcp bulk transfer timed out\n");
+        else
+                printf("tcp bulk %zu MB:     %10.2f Mbit/s\n", total >> 20, total * 8 / t / 1e6);
+        printf("tcp retransmits: fast %lu, partial ack %lu, sack %lu, timeout %lu, after timeout %lu\n",
+                tcp_stats.fast_retransmits, tcp_stats.partial_retransmits,
+                tcp_stats.sack_retransmits, tcp_stats.timeout_retransmits,
+                tcp_stats.loss_retransmits);
+        printf("frames sent %lu, lost %lu, reordered %lu, overflow %lu\n",
+                driver_loopback_stats.sent, driver_loopback_stats.lost,
+                driver_loopback_stats.reordered, driver_loopback_stats.overflow);
+}
+
+/* 依次用各拥塞控制算法传输，比较吞吐量、重传次数和瓶颈处的排队时延。
+ * 限速时传输量取约3秒能发完的数据 */
+static void bench_cc(const driver_loopback_impair_t *impair)
+{
+        const char *algs[] = {"reno", "cubic", "bbr"};
+        size_t total = impair->rate_mbps ? (size_t)impair->rate_mbps * 3 / 8 << 20
+                                         : 256 << 20;
+        for (size_t i = 0; i < sizeof(algs) / sizeof(algs[0]); i++){
+                tcp_stats_t stats = tcp_stats;
+                driver_loopback_stats_t link = driver_loopback_stats;
+                double t = tcp_bulk(total, 60, algs[i]);
+                uint64_t queued = driver_loopback_stats.queued - link.queued;
+                uint64_t delay = driver_loopback_stats.queue_delay_us - link.queue_delay_us;
+                if (t < 0)
+                        printf("%-6s %zu MB: timed out\n", algs[i], total >> 20);
+                else
+                        printf("%-6s %zu MB: %9.2f Mbit/s", algs[i], total >> 20,
+                                total * 8 / t / 1e6);
+                printf("  retransmits fast %lu sack %lu timeout %lu  queue drops %lu  avg queue delay %.2f ms\n",
+                        tcp_stats.fast_retransmits - stats.fast_retransmits,
+                        tcp_stats.sack_retransmits - stats.sack_retransmits,
+                        tcp_stats.timeout_retransmits - stats.timeout_retransmits,
+                        driver_loopback_stats.queue_drops - link.queue_drops,
+                        queued ? delay / 1e3 / queued : 0);
+        }
+}
+
+int main(int argc, char* argv[])
+{
+        driver_loopback_impair_t impair = {0};
+        char cc[16] = "";
+        int conns = TCP_LOSS_CONNS;
+        for (int i = 2; i < argc; i++){
+                sscanf(argv[i], "loss=%lf", &impair.loss);
+                sscanf(argv[i], "reorder=%lf", &impair.reorder);
+                sscanf(argv[i], "delay=%u", &impair.delay_ms);
+                sscanf(argv[i], "rate=%u", &impair.rate_mbps);
+                sscanf(argv[i], "queue=%u", &impair.queue_bytes);
+                sscanf(argv[i], "cc=%15s", cc);
+                sscanf(argv[i], "conns=%d", &conns);
+                sscanf(argv[i], "sack=%d", &tcp_sack); /* 两端都生效 */
+                sscanf(argv[i], "ts=%d", &tcp_timestamps);
+        }
+
+        if (driver_loopback_pair() < 0)
+                return -1;
+        pid_t pid = spawn_peer(&impair);
+        driver_loopback_side(0, &impair);
+        if (net_init() == -1)
+                return -1;
+        udp_open(PORT, reply_handler);
+
+        int ret = 0;
+        if (argc >= 2 && !strcmp(argv[1], "bench"))
+                bench();
+        else if (argc >= 2 && !strcmp(argv[1], "tcp"))
+                bench_cc(&impair);
+        else if (impair.loss > 0 || impair.reorder > 0)
+                ret = check_impaired(cc[0] ? cc : NULL, conns);
+        else
+                ret = check();
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return ret;
+}